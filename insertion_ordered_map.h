@@ -2,9 +2,27 @@
 #define INSERTION_ORDERED_MAP_H
 
 #include <iostream>
-#include <list>
-#include <unordered_map>
 #include <memory>
+#include <atomic>
+#include <new>
+#include <iterator>
+#include <initializer_list>
+#include <optional>
+#include <utility>
+#include <functional>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <limits>
+#include <thread>
+#include <mutex>
+
+// defining INSERTION_ORDERED_MAP_NO_SIMD forces the portable probing code
+#if defined(__SSE2__) && !defined(INSERTION_ORDERED_MAP_NO_SIMD)
+#include <emmintrin.h>
+#define INSERTION_ORDERED_MAP_SSE2 1
+#endif
 
 #include <vector>
 #include <cassert>
@@ -13,343 +31,2965 @@ class lookup_error : public std::exception
 {
     const char * what () const noexcept override
     {
-        return "lookup_error";
+        return "lookup_error";
+    }
+};
+
+template <class Map>
+class snapshot_cell;
+
+template <class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>,
+          class Allocator = std::allocator<std::pair<K, V>>>
+class insertion_ordered_map {
+private:
+    template <class Map>
+    friend class snapshot_cell;
+
+    template <class, class, class, class, class>
+    friend class concurrent_insertion_ordered_map;
+
+    template <class T>
+    using alloc_of = typename allocator_traits<Allocator>::template rebind_alloc<T>;
+
+    template <class T>
+    using traits_of = allocator_traits<alloc_of<T>>;
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    /* one slot of the slab
+     * live slots hold a constructed pair and are linked in insertion order,
+     * free slots hold nothing and are chained through next
+     */
+    struct node {
+        size_t hash;    // of the key, kept so that the index never hashes a key again
+        size_t prev;
+        size_t next;
+        alignas(pair<K,V>) unsigned char raw[sizeof(pair<K,V>)];
+
+        pair<K,V> &kv() noexcept
+        {
+            return *launder(reinterpret_cast<pair<K,V> *>(raw));
+        }
+
+        pair<K,V> const &kv() const noexcept
+        {
+            return *launder(reinterpret_cast<pair<K,V> const *>(raw));
+        }
+    };
+
+    /* owns one entry taken out of a map by extract(), together with its
+     * cached hash, until insert() links it into a map again
+     * the allocator is constructed, never assigned, as allocators such
+     * as polymorphic_allocator cannot be assigned, an empty handle has none
+     */
+    class node_handle {
+    private:
+        optional<Allocator> alloc;
+        size_t hash = 0;
+        bool full = false;
+        bool hashed = true;  // false once the key may have been changed through key()
+        alignas(pair<K,V>) unsigned char raw[sizeof(pair<K,V>)];
+
+        friend class insertion_ordered_map;
+
+        pair<K,V> &kv() noexcept
+        {
+            return *launder(reinterpret_cast<pair<K,V> *>(raw));
+        }
+
+        void reset() noexcept
+        {
+            if (full) {
+                allocator_traits<Allocator>::destroy(*alloc, &kv());
+                full = false;
+            }
+            alloc.reset();
+        }
+
+        /* takes the entry of other, which must hold one */
+        void take(node_handle &other)
+        {
+            alloc.emplace(*other.alloc);
+            hash = other.hash;
+            allocator_traits<Allocator>::construct(*alloc, &kv(), std::move(other.kv()));
+            full = true;
+            hashed = other.hashed;
+            other.reset();
+        }
+
+    public:
+        node_handle() noexcept = default;
+
+        node_handle(node_handle &&other) noexcept(is_nothrow_move_constructible<pair<K,V>>::value)
+        {
+            if (other.full) {
+                take(other);
+            }
+        }
+
+        node_handle &operator=(node_handle &&other) noexcept(is_nothrow_move_constructible<pair<K,V>>::value)
+        {
+            if (this != &other) {
+                reset();
+                if (other.full) {
+                    take(other);
+                }
+            }
+            return *this;
+        }
+
+        ~node_handle() noexcept
+        {
+            reset();
+        }
+
+        bool empty() const noexcept
+        {
+            return !full;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return full;
+        }
+
+        /* the key may be changed before the entry is inserted again,
+         * its hash is then computed anew
+         */
+        K &key() noexcept
+        {
+            hashed = false;
+            return kv().first;
+        }
+
+        V &mapped() noexcept
+        {
+            return kv().second;
+        }
+
+        /* the allocator of the map the entry came from, a default one
+         * for an empty handle
+         */
+        Allocator get_allocator() const noexcept
+        {
+            return alloc ? *alloc : Allocator();
+        }
+    };
+
+    /* sixteen consecutive cells of the index
+     * ctrl holds for every cell either a marker or 7 bits of the key's hash,
+     * so a probe compares keys only when these bits match
+     */
+    struct group {
+        static constexpr size_t width = 16;
+        static constexpr int8_t emptyCtrl = -128;
+        static constexpr int8_t deletedCtrl = -2;
+
+        alignas(16) int8_t ctrl[width];
+        uint32_t slot[width];
+
+#ifdef INSERTION_ORDERED_MAP_SSE2
+        /* one compare covers the whole group, movemask turns it into bits */
+        uint32_t match(int8_t h2) const noexcept
+        {
+            __m128i c = _mm_load_si128(reinterpret_cast<__m128i const *>(ctrl));
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(h2))));
+        }
+
+        /* markers are exactly the negative ctrl bytes */
+        uint32_t match_free() const noexcept
+        {
+            __m128i c = _mm_load_si128(reinterpret_cast<__m128i const *>(ctrl));
+            return static_cast<uint32_t>(_mm_movemask_epi8(c));
+        }
+#else
+        /* bit i set iff cell i holds fragment h2 */
+        uint32_t match(int8_t h2) const noexcept
+        {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < width; i++) {
+                mask |= static_cast<uint32_t>(ctrl[i] == h2) << i;
+            }
+            return mask;
+        }
+
+        uint32_t match_free() const noexcept
+        {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < width; i++) {
+                mask |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+            }
+            return mask;
+        }
+#endif
+
+        uint32_t match_empty() const noexcept
+        {
+            return match(emptyCtrl);
+        }
+    };
+
+    static size_t lowest_bit(uint32_t mask) noexcept
+    {
+        return static_cast<size_t>(__builtin_ctz(mask));
+    }
+
+    /* a fixed run of slots, shared by storages until one of them writes
+     * to it, live has bit i set while slot i holds an entry
+     */
+    struct page {
+        static constexpr size_t shift = 5;
+        static constexpr size_t width = size_t(1) << shift;
+
+        atomic<size_t> refs{1};
+        uint32_t live = 0;
+        node n[width];
+    };
+
+    /* selects the storage constructor that copies entries instead of sharing them */
+    struct deep_copy_t {};
+
+    /* the index keeps its reference count in front of its groups */
+    static_assert(sizeof(atomic<size_t>) <= sizeof(group), "index header does not fit in a group");
+
+    /* everything one map owns: slots in pages, linked in insertion order,
+     * and an open-addressing index holding slot numbers
+     * a map of at most smallLimit entries has no index, lookups walk its
+     * entries comparing cached hashes, and a cell number is the slot itself
+     * copies of the map share one storage until one of them writes,
+     * then the writer gets a storage of its own that still shares the
+     * pages and the index, and copies a page or the index only when it
+     * is about to change it
+     * this is not a persistent structure: a detach costs a table of n/32
+     * page pointers, one reference count increment each, and the first
+     * insert or erase after it copies the whole index, so a structural
+     * write to a shared map is O(n), only writes to values stay within
+     * one page of 32 entries
+     */
+    class storage {
+    public:
+        static constexpr size_t smallLimit = 8;
+        static constexpr float defaultMaxFree = 0.5f;
+
+        atomic<size_t> refs{1}; // maps and handles sharing this storage
+        Allocator alloc;        // for the storage itself, its arrays and entries
+
+        page **pages = nullptr;
+        size_t capacity = 0;    // slots in pages
+        size_t used = 0;        // slots ever handed out, the rest were never touched
+        size_t freeHead = npos; // free list of released slots
+        size_t head = npos;
+        size_t tail = npos;
+        size_t count = 0;
+
+        group *groups = nullptr;
+        size_t groupMask = 0;   // group count - 1, groups is null while small
+        size_t tombstones = 0;  // cells marked deleted
+        Hash hasher;
+        KeyEqual equal;
+
+        explicit storage(Allocator const &a, Hash const &h = Hash(), KeyEqual const &e = KeyEqual()) :
+                alloc(a), hasher(h), equal(e)
+        {}
+
+        /* shares the pages and the index of other, with room for at least
+         * minCapacity entries
+         */
+        storage(storage const &other, size_t minCapacity = 0) :
+                storage(other.alloc, other.hasher, other.equal)
+        {
+            if (other.capacity != 0) {
+                pages = allocate<page *>(other.capacity >> page::shift);
+                capacity = other.capacity;
+                for (size_t i = 0; i < (capacity >> page::shift); i++) {
+                    pages[i] = other.pages[i];
+                    pages[i]->refs.fetch_add(1, memory_order_relaxed);
+                }
+            }
+            if (other.groups != nullptr) {
+                groups = other.groups;
+                index_refs(groups).fetch_add(1, memory_order_relaxed);
+            }
+            used = other.used;
+            freeHead = other.freeHead;
+            head = other.head;
+            tail = other.tail;
+            count = other.count;
+            groupMask = other.groupMask;
+            tombstones = other.tombstones;
+            reserve(minCapacity);
+        }
+
+        /* copies the entries of other into pages of its own, densely and in
+         * insertion order, and indexes them by their cached hashes
+         */
+        storage(deep_copy_t, storage const &other) :
+                storage(other.alloc, other.hasher, other.equal)
+        {
+            reserve(other.count);
+            for (size_t i = other.head; i != npos; i = other.node_at(i).next) {
+                push_back(other.node_at(i).hash, other.node_at(i).kv());
+            }
+        }
+
+        storage &operator=(storage const &) = delete;
+
+        ~storage() noexcept
+        {
+            release_pages();
+            release_index();
+        }
+
+        /* storages are themselves allocated with the map's allocator */
+        template <class... Args>
+        static storage *make(Allocator const &a, Args &&... args)
+        {
+            alloc_of<storage> sa(a);
+            storage *p = traits_of<storage>::allocate(sa, 1);
+            try {
+                ::new (static_cast<void *>(p)) storage(std::forward<Args>(args)...);
+            } catch (...) {
+                traits_of<storage>::deallocate(sa, p, 1);
+                throw;
+            }
+            return p;
+        }
+
+        static void dispose(storage *p) noexcept
+        {
+            alloc_of<storage> sa(p->alloc);
+            p->~storage();
+            traits_of<storage>::deallocate(sa, p, 1);
+        }
+
+        /* spreads the user hash over all bits, the low 7 go to ctrl
+         * and the rest choose the first group to probe
+         */
+        static size_t mix(size_t h) noexcept
+        {
+            uint64_t x = static_cast<uint64_t>(h) * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(x ^ (x >> 32));
+        }
+
+        static int8_t fragment(size_t mixed) noexcept
+        {
+            return static_cast<int8_t>(mixed & 0x7f);
+        }
+
+        /* writing through the non-const overload requires own(slot) */
+        node &node_at(size_t slot) noexcept
+        {
+            return pages[slot >> page::shift]->n[slot & (page::width - 1)];
+        }
+
+        node const &node_at(size_t slot) const noexcept
+        {
+            return pages[slot >> page::shift]->n[slot & (page::width - 1)];
+        }
+
+        /* makes the page of slot private to this storage,
+         * on failure nothing is changed
+         */
+        void own(size_t slot)
+        {
+            page *&p = pages[slot >> page::shift];
+            if (p->refs.load(memory_order_acquire) != 1) {
+                page *copy = copy_page(*p);
+                release_page(p);
+                p = copy;
+            }
+        }
+
+        /* makes the index private to this storage, on failure nothing is changed */
+        void own_index()
+        {
+            if (groups != nullptr && index_refs(groups).load(memory_order_acquire) != 1) {
+                group *copy = new_groups(groupMask + 1);
+                std::copy(groups, groups + groupMask + 1, copy);
+                release_index();
+                groups = copy;
+            }
+        }
+
+        /* owns everything erase_cell() writes when dropping slot */
+        void prepare_erase(size_t slot)
+        {
+            size_t prev = node_at(slot).prev;
+            size_t next = node_at(slot).next;
+            own(slot);
+            if (prev != npos) {
+                own(prev);
+            }
+            if (next != npos) {
+                own(next);
+            }
+            own_index();
+        }
+
+        /* starts loading the group a lookup of hash h probes first,
+         * both of its cache lines
+         */
+        void prefetch_group(size_t h) const noexcept
+        {
+            if (groups != nullptr) {
+                group const &grp = groups[(mix(h) >> 7) & groupMask];
+                __builtin_prefetch(grp.ctrl);
+                __builtin_prefetch(&grp.slot[group::width - 1]);
+            }
+        }
+
+        /* returns the index cell (group * width + offset) holding key k, or npos
+         * k is a K or, with transparent Hash and KeyEqual, anything they accept
+         */
+        template <class Q>
+        size_t find_cell(Q const &k, size_t h) const
+        {
+            if (groups == nullptr) {
+                for (size_t i = head; i != npos; i = node_at(i).next) {
+                    if (node_at(i).hash == h && equal(node_at(i).kv().first, k)) {
+                        return i;
+                    }
+                }
+                return npos;
+            }
+            size_t mixed = mix(h);
+            int8_t h2 = fragment(mixed);
+            for (size_t g = (mixed >> 7) & groupMask, step = 1;; g = (g + step++) & groupMask) {
+                group const &grp = groups[g];
+                for (uint32_t m = grp.match(h2); m != 0; m &= m - 1) {
+                    size_t i = lowest_bit(m);
+                    if (equal(node_at(grp.slot[i]).kv().first, k)) {
+                        return g * group::width + i;
+                    }
+                }
+                if (grp.match_empty() != 0) {
+                    return npos;
+                }
+            }
+        }
+
+        size_t slot_of(size_t cell) const noexcept
+        {
+            return groups ? groups[cell / group::width].slot[cell % group::width] : cell;
+        }
+
+        template <class Q>
+        size_t find(Q const &k, size_t h) const
+        {
+            size_t c = find_cell(k, h);
+            return c == npos ? npos : slot_of(c);
+        }
+
+        /* makes room for one more entry in both the pages and the index
+         * and owns all that appending it writes, on failure nothing is changed
+         */
+        void reserve_one()
+        {
+            if (freeHead == npos && used == capacity) {
+                grow_slab(capacity == 0 ? page::width : 2 * capacity);
+            }
+            if ((groups != nullptr || count + 1 > smallLimit) && (count + tombstones + 1) * 8 > cells() * 7) {
+                size_t groupCount = 1;
+                while (groupCount * group::width < (count + 1) * 2) {
+                    groupCount *= 2;
+                }
+                rehash(groupCount);
+            }
+            own(freeHead != npos ? freeHead : used);
+            if (tail != npos) {
+                own(tail);
+            }
+            own_index();
+        }
+
+        size_t cells() const noexcept
+        {
+            return groups ? (groupMask + 1) * group::width : 0;
+        }
+
+        /* smallest group count that indexes n entries within the 7/8 load limit */
+        static size_t groups_for(size_t n) noexcept
+        {
+            size_t groupCount = 1;
+            while (groupCount * group::width * 7 < n * 8) {
+                groupCount *= 2;
+            }
+            return groupCount;
+        }
+
+        /* makes room for n entries in total, on failure nothing is changed */
+        void reserve(size_t n)
+        {
+            if (n > capacity) {
+                grow_slab((n + page::width - 1) & ~(page::width - 1));
+            }
+            if (n > smallLimit && (n + tombstones) * 8 > cells() * 7) {
+                rehash(max(groups_for(n), groups ? groupMask + 1 : 0));
+            }
+        }
+
+        /* sets the index to at least groupCount groups, enough for the
+         * entries held, no groups at all for a small map
+         */
+        void resize_index(size_t groupCount)
+        {
+            if (count <= smallLimit && groupCount == 0) {
+                release_index();
+                groupMask = 0;
+                tombstones = 0;
+                return;
+            }
+            rehash(max(groupCount, groups_for(count)));
+        }
+
+        /* moves the entries in order to the front of as few pages as
+         * hold them and rebuilds the index at the smallest size that fits
+         * entries are moved only when none of them can throw on the way
+         * and none sits in a page shared with another storage, otherwise
+         * they are copied
+         */
+        void shrink_to_fit()
+        {
+            if (count == 0) {
+                clear();
+                release_pages();
+                resize_index(0);
+                return;
+            }
+            size_t pageCount = (count + page::width - 1) >> page::shift;
+            bool indexFits = count <= smallLimit ? groups == nullptr :
+                                                   groups != nullptr && groups_for(count) == groupMask + 1;
+            if (used == count && (capacity >> page::shift) == pageCount && indexFits) {
+                return;
+            }
+            storage packed(alloc, hasher, equal);
+            packed.reserve(count);
+            if (owns_pages()) {
+                for (size_t i = head; i != npos; i = node_at(i).next) {
+                    packed.push_back(node_at(i).hash, move_if_noexcept(node_at(i).kv()));
+                }
+            } else {
+                for (size_t i = head; i != npos; i = node_at(i).next) {
+                    packed.push_back(node_at(i).hash, as_const(node_at(i).kv()));
+                }
+            }
+            swap_contents(packed);
+        }
+
+        /* packs the entries in iteration order before the one in slot is
+         * erased, once erasing it would leave more than maxFree of the used
+         * slots free, so that iteration walks memory in order again,
+         * returns whether it did, slot is then updated
+         * entries in pages shared with a copy are copied rather than moved,
+         * so packing is never put off, which would leave every later erase
+         * checking again, on failure it changes nothing, and erasing
+         * afterwards cannot fail as all is owned
+         */
+        bool compact_for_erase(size_t &slot, float maxFree)
+        {
+            bool due = used >= 4 * page::width &&
+                       static_cast<float>(used - count + 1) > maxFree * static_cast<float>(used);
+            if (!due) {
+                return false;
+            }
+            size_t rank = 0;
+            for (size_t i = head; i != slot; i = node_at(i).next) {
+                rank++;
+            }
+            shrink_to_fit();
+            slot = rank;
+            return true;
+        }
+
+        /* appends a new entry, room must be reserved and its key must be absent */
+        template <class... Args>
+        size_t push_back(size_t h, Args &&... args)
+        {
+            size_t slot = construct(std::forward<Args>(args)...);
+            adopt(slot, h);
+            return slot;
+        }
+
+        /* builds an entry in the slot push_back would use next, leaving it
+         * unlinked and unindexed, room must be reserved
+         */
+        template <class... Args>
+        size_t construct(Args &&... args)
+        {
+            size_t slot = freeHead != npos ? freeHead : used;
+            construct_at(slot, std::forward<Args>(args)...);
+            return slot;
+        }
+
+        /* appends the entry made by construct() */
+        void adopt(size_t slot, size_t h) noexcept
+        {
+            if (slot == freeHead) {
+                freeHead = node_at(slot).next;
+            } else {
+                used++;
+            }
+            node_at(slot).hash = h;
+            link_back(slot);
+            count++;
+            if (groups != nullptr && place(groups, groupMask, slot) == group::deletedCtrl) {
+                tombstones--;
+            }
+        }
+
+        /* on failure nothing is changed */
+        void move_to_back(size_t slot)
+        {
+            if (slot == tail) {
+                return;
+            }
+            size_t prev = node_at(slot).prev;
+            size_t next = node_at(slot).next;
+            own(slot);
+            if (prev != npos) {
+                own(prev);
+            }
+            own(next);
+            own(tail);
+            unlink(slot);
+            link_back(slot);
+        }
+
+        /* on failure nothing is changed */
+        void erase_cell(size_t c)
+        {
+            size_t slot = slot_of(c);
+            prepare_erase(slot);
+            if (groups != nullptr) {
+                group &grp = groups[c / group::width];
+                // a probe stops at a group with an empty cell, so such a group
+                // can take another empty one, otherwise a marker keeps probes going
+                if (grp.match_empty() != 0) {
+                    grp.ctrl[c % group::width] = group::emptyCtrl;
+                } else {
+                    grp.ctrl[c % group::width] = group::deletedCtrl;
+                    tombstones++;
+                }
+            }
+            unlink(slot);
+            destroy_at(slot);
+            node_at(slot).next = freeHead;
+            freeHead = slot;
+            count--;
+        }
+
+        /* index cell of a live slot, found by its cached hash without
+         * comparing keys
+         */
+        size_t cell_of(size_t slot) const noexcept
+        {
+            if (groups == nullptr) {
+                return slot;
+            }
+            size_t mixed = mix(node_at(slot).hash);
+            int8_t h2 = fragment(mixed);
+            for (size_t g = (mixed >> 7) & groupMask, step = 1;; g = (g + step++) & groupMask) {
+                group const &grp = groups[g];
+                for (uint32_t m = grp.match(h2); m != 0; m &= m - 1) {
+                    size_t i = lowest_bit(m);
+                    if (grp.slot[i] == slot) {
+                        return g * group::width + i;
+                    }
+                }
+            }
+        }
+
+        /* puts slot back right after prev, at the front if prev is npos,
+         * the pages involved must be owned already
+         */
+        void relink_after(size_t slot, size_t prev) noexcept
+        {
+            if (node_at(slot).prev == prev) {
+                return;
+            }
+            unlink(slot);
+            size_t next = prev == npos ? head : node_at(prev).next;
+            node_at(slot).prev = prev;
+            node_at(slot).next = next;
+            (prev == npos ? head : node_at(prev).next) = slot;
+            (next == npos ? tail : node_at(next).prev) = slot;
+        }
+
+        /* entries in pages of its own are destroyed in place, a storage
+         * sharing pages or the index with another one gives them up
+         */
+        void clear() noexcept
+        {
+            if (!owns_pages() || (groups != nullptr && index_refs(groups).load(memory_order_acquire) != 1)) {
+                release_pages();
+                release_index();
+                groupMask = 0;
+            } else {
+                for (size_t p = 0; p < (capacity >> page::shift); p++) {
+                    destroy_entries(*pages[p]);
+                }
+                for (size_t g = 0; groups != nullptr && g <= groupMask; g++) {
+                    fill_n(groups[g].ctrl, group::width, group::emptyCtrl);
+                }
+            }
+            used = 0;
+            freeHead = head = tail = npos;
+            count = 0;
+            tombstones = 0;
+        }
+
+        /* entries are built and destroyed through the allocator,
+         * so scoped and polymorphic allocators reach keys and values too
+         */
+        template <class... Args>
+        void construct_at(size_t slot, Args &&... args)
+        {
+            allocator_traits<Allocator>::construct(alloc, &node_at(slot).kv(), std::forward<Args>(args)...);
+            pages[slot >> page::shift]->live |= uint32_t(1) << (slot & (page::width - 1));
+        }
+
+        void destroy_at(size_t slot) noexcept
+        {
+            allocator_traits<Allocator>::destroy(alloc, &node_at(slot).kv());
+            pages[slot >> page::shift]->live &= ~(uint32_t(1) << (slot & (page::width - 1)));
+        }
+
+    private:
+        template <class T>
+        T *allocate(size_t n)
+        {
+            alloc_of<T> a(alloc);
+            return traits_of<T>::allocate(a, n);
+        }
+
+        template <class T>
+        void deallocate(T *p, size_t n) noexcept
+        {
+            if (p != nullptr) {
+                alloc_of<T> a(alloc);
+                traits_of<T>::deallocate(a, p, n);
+            }
+        }
+
+        /* slot numbers have to fit in the 32 bits the index keeps */
+        static void check_capacity(size_t n)
+        {
+            if (n > UINT32_MAX) {
+                throw length_error("insertion_ordered_map too large");
+            }
+        }
+
+        static atomic<size_t> &index_refs(group *gs) noexcept
+        {
+            return *launder(reinterpret_cast<atomic<size_t> *>(gs - 1));
+        }
+
+        /* groups with a reference count of 1 in front of them */
+        group *new_groups(size_t groupCount)
+        {
+            group *gs = allocate<group>(groupCount + 1);
+            ::new (static_cast<void *>(gs)) atomic<size_t>(1);
+            gs++;
+            for (size_t g = 0; g < groupCount; g++) {
+                fill_n(gs[g].ctrl, group::width, group::emptyCtrl);
+            }
+            return gs;
+        }
+
+        void release_index() noexcept
+        {
+            if (groups != nullptr && index_refs(groups).fetch_sub(1, memory_order_acq_rel) == 1) {
+                deallocate(groups - 1, groupMask + 2);
+            }
+            groups = nullptr;
+        }
+
+        bool owns_pages() const noexcept
+        {
+            for (size_t p = 0; p < (capacity >> page::shift); p++) {
+                if (pages[p]->refs.load(memory_order_acquire) != 1) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /* trivial entries are not visited, so with an arena allocator
+         * dropping a page costs nothing per entry
+         */
+        void destroy_entries(page &p) noexcept
+        {
+            if (!is_trivially_destructible<pair<K,V>>::value) {
+                for (uint32_t m = p.live; m != 0; m &= m - 1) {
+                    allocator_traits<Allocator>::destroy(alloc, &p.n[lowest_bit(m)].kv());
+                }
+            }
+            p.live = 0;
+        }
+
+        page *new_page()
+        {
+            page *p = allocate<page>(1);
+            ::new (static_cast<void *>(p)) page();
+            return p;
+        }
+
+        void release_page(page *p) noexcept
+        {
+            if (p->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+                destroy_entries(*p);
+                p->~page();
+                deallocate(p, 1);
+            }
+        }
+
+        void release_pages() noexcept
+        {
+            for (size_t p = 0; p < (capacity >> page::shift); p++) {
+                release_page(pages[p]);
+            }
+            deallocate(pages, capacity >> page::shift);
+            pages = nullptr;
+            capacity = 0;
+        }
+
+        page *copy_page(page const &from)
+        {
+            page *p = new_page();
+            uint32_t m = from.live;
+            try {
+                for (; m != 0; m &= m - 1) {
+                    size_t i = lowest_bit(m);
+                    allocator_traits<Allocator>::construct(alloc, &p->n[i].kv(), from.n[i].kv());
+                    p->live |= uint32_t(1) << i;
+                }
+            } catch (...) {
+                release_page(p);
+                throw;
+            }
+            for (size_t i = 0; i < page::width; i++) {
+                p->n[i].hash = from.n[i].hash;
+                p->n[i].prev = from.n[i].prev;
+                p->n[i].next = from.n[i].next;
+            }
+            return p;
+        }
+
+        /* adds empty pages, entries stay where they are */
+        void grow_slab(size_t newCapacity)
+        {
+            check_capacity(newCapacity);
+            size_t oldCount = capacity >> page::shift;
+            size_t newCount = newCapacity >> page::shift;
+            page **fresh = allocate<page *>(newCount);
+            size_t p = oldCount;
+            try {
+                for (; p < newCount; p++) {
+                    fresh[p] = new_page();
+                }
+            } catch (...) {
+                for (size_t q = oldCount; q < p; q++) {
+                    release_page(fresh[q]);
+                }
+                deallocate(fresh, newCount);
+                throw;
+            }
+            std::copy(pages, pages + oldCount, fresh);
+            deallocate(pages, oldCount);
+            pages = fresh;
+            capacity = newCapacity;
+        }
+
+        void swap_contents(storage &other) noexcept
+        {
+            std::swap(pages, other.pages);
+            std::swap(capacity, other.capacity);
+            std::swap(used, other.used);
+            std::swap(freeHead, other.freeHead);
+            std::swap(head, other.head);
+            std::swap(tail, other.tail);
+            std::swap(count, other.count);
+            std::swap(groups, other.groups);
+            std::swap(groupMask, other.groupMask);
+            std::swap(tombstones, other.tombstones);
+        }
+
+        void link_back(size_t slot) noexcept
+        {
+            node_at(slot).prev = tail;
+            node_at(slot).next = npos;
+            if (tail != npos) {
+                node_at(tail).next = slot;
+            } else {
+                head = slot;
+            }
+            tail = slot;
+        }
+
+        void unlink(size_t slot) noexcept
+        {
+            node &n = node_at(slot);
+            if (n.prev != npos) {
+                node_at(n.prev).next = n.next;
+            } else {
+                head = n.next;
+            }
+            if (n.next != npos) {
+                node_at(n.next).prev = n.prev;
+            } else {
+                tail = n.prev;
+            }
+        }
+
+        /* first cell on the probe sequence of mixed that holds no key */
+        static size_t free_cell(group const *gs, size_t mask, size_t mixed) noexcept
+        {
+            for (size_t g = (mixed >> 7) & mask, step = 1;; g = (g + step++) & mask) {
+                uint32_t m = gs[g].match_free();
+                if (m != 0) {
+                    return g * group::width + lowest_bit(m);
+                }
+            }
+        }
+
+        /* indexes slot by its cached hash, returns what the cell held before */
+        int8_t place(group *gs, size_t mask, size_t slot) noexcept
+        {
+            size_t mixed = mix(node_at(slot).hash);
+            size_t c = free_cell(gs, mask, mixed);
+            group &grp = gs[c / group::width];
+            int8_t old = grp.ctrl[c % group::width];
+            grp.ctrl[c % group::width] = fragment(mixed);
+            grp.slot[c % group::width] = static_cast<uint32_t>(slot);
+            return old;
+        }
+
+        void rehash(size_t groupCount)
+        {
+            group *fresh = new_groups(groupCount);
+            for (size_t i = head; i != npos; i = node_at(i).next) {
+                place(fresh, groupCount - 1, i);
+            }
+            release_index();
+            groups = fresh;
+            groupMask = groupCount - 1;
+            tombstones = 0;
+        }
+    };
+
+    /* owning handle to a storage, copying it costs one atomic increment */
+    class ref {
+    private:
+        storage *p = nullptr;
+
+    public:
+        ref() noexcept = default;
+
+        explicit ref(storage *s) noexcept : p(s)
+        {}
+
+        ref(ref const &other) noexcept : p(other.p)
+        {
+            if (p) {
+                p->refs.fetch_add(1, memory_order_relaxed);
+            }
+        }
+
+        ref(ref &&other) noexcept : p(other.p)
+        {
+            other.p = nullptr;
+        }
+
+        ref &operator=(ref other) noexcept
+        {
+            std::swap(p, other.p);
+            return *this;
+        }
+
+        ~ref() noexcept
+        {
+            if (p && p->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+                storage::dispose(p);
+            }
+        }
+
+        storage *get() const noexcept
+        {
+            return p;
+        }
+
+        storage *operator->() const noexcept
+        {
+            return p;
+        }
+
+        storage &operator*() const noexcept
+        {
+            return *p;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return p != nullptr;
+        }
+
+        bool unique() const noexcept
+        {
+            return p->refs.load(memory_order_acquire) == 1;
+        }
+
+        bool operator==(ref const &other) const noexcept
+        {
+            return p == other.p;
+        }
+
+        bool operator!=(ref const &other) const noexcept
+        {
+            return p != other.p;
+        }
+    };
+
+    /* keeps a T, taking no room when T is empty, and is replaced
+     * instead of assigned, as allocators such as polymorphic_allocator
+     * cannot be assigned, an empty T has nothing to replace
+     * Tag keeps holders of one type apart
+     */
+    template <class T, int Tag, bool = is_empty<T>::value && !is_final<T>::value>
+    class held {
+    private:
+        optional<T> value;
+
+    public:
+        explicit held(T const &v) : value(v)
+        {}
+
+        T const &get() const noexcept
+        {
+            return *value;
+        }
+
+        void replace(T const &v)
+        {
+            value.emplace(v);
+        }
+    };
+
+    template <class T, int Tag>
+    class held<T, Tag, true> : private T {
+    public:
+        explicit held(T const &v) : T(v)
+        {}
+
+        T const &get() const noexcept
+        {
+            return *this;
+        }
+
+        void replace(T const &) noexcept
+        {}
+    };
+
+    /* the allocator and functors a map was made with, a storage it
+     * builds for itself, as after being moved from, starts from them
+     */
+    class functors : private held<Allocator, 0>, private held<Hash, 1>, private held<KeyEqual, 2> {
+    public:
+        functors(Allocator const &a, Hash const &h, KeyEqual const &e) :
+                held<Allocator, 0>(a), held<Hash, 1>(h), held<KeyEqual, 2>(e)
+        {}
+
+        Allocator const &alloc() const noexcept
+        {
+            return held<Allocator, 0>::get();
+        }
+
+        Hash const &hash() const noexcept
+        {
+            return held<Hash, 1>::get();
+        }
+
+        KeyEqual const &equal() const noexcept
+        {
+            return held<KeyEqual, 2>::get();
+        }
+
+        /* allocators cannot throw when copied */
+        void replace(functors const &other)
+        {
+            held<Hash, 1>::replace(other.hash());
+            held<KeyEqual, 2>::replace(other.equal());
+            held<Allocator, 0>::replace(other.alloc());
+        }
+
+        storage *make_storage() const
+        {
+            return storage::make(alloc(), alloc(), hash(), equal());
+        }
+    };
+
+    static constexpr bool nothrowFunctors =
+            is_nothrow_default_constructible<Hash>::value && is_nothrow_copy_constructible<Hash>::value &&
+            is_nothrow_default_constructible<KeyEqual>::value && is_nothrow_copy_constructible<KeyEqual>::value;
+
+    ref body;
+    bool isTaken = false;
+    functors fn;
+    // max_free_fraction(), the map's and not the storage's, as storages
+    // are shared, replaced and handed over between maps
+    float maxFree = storage::defaultMaxFree;
+
+    /* a map without storage is empty, one with interchangeable allocators
+     * starts and clears to that state and allocates on its first write,
+     * other ones get a storage from their allocator when made or cleared
+     */
+    static constexpr bool lazyStorage = allocator_traits<Allocator>::is_always_equal::value;
+
+    /* storage this map may write to: its own one when not shared,
+     * otherwise one sharing its pages and index, with the same slot
+     * numbers and room for minCapacity entries, parked in fresh, which the
+     * caller installs with commit() once the whole operation succeeded
+     */
+    storage *writable(ref &fresh, size_t minCapacity = 0) const
+    {
+        if (body && body.unique()) {
+            return body.get();
+        }
+        if (body) {
+            fresh = ref(storage::make(body->alloc, *body, minCapacity));
+        } else {
+            fresh = ref(fn.make_storage());
+        }
+        return fresh.get();
+    }
+
+    void commit(ref &fresh) noexcept
+    {
+        if (fresh) {
+            body = move(fresh);
+        }
+    }
+
+    /* T&& when T can be built from it, T const & otherwise, so that
+     * types with a deleted move constructor are still accepted
+     */
+    template <class T>
+    static conditional_t<is_constructible<T, T&&>::value, T&&, T const &> move_if_movable(T &t) noexcept
+    {
+        return std::move(t);
+    }
+
+    /* common part of insert and try_emplace, args build the value
+     * and are used only when k is new
+     */
+    template <class KK, class... Args>
+    bool insert_impl(KK &&k, Args &&... args)
+    {
+        size_t h = body ? body->hasher(k) : fn.hash()(k);
+        return insert_hashed_impl(h, std::forward<KK>(k), std::forward<Args>(args)...);
+    }
+
+    /* insert_impl for a key whose hash h is already known */
+    template <class KK, class... Args>
+    bool insert_hashed_impl(size_t h, KK &&k, Args &&... args)
+    {
+        size_t slot = npos;
+        if (body) {
+            slot = body->find(k, h);
+            if (slot != npos && slot == body->tail) {
+                return false;
+            }
+        }
+        ref fresh;
+        storage *target = writable(fresh, slot == npos ? size() + 1 : 0);
+        bool newElem = (slot == npos);
+        if (newElem) {
+            target->reserve_one();
+            target->push_back(h, piecewise_construct, forward_as_tuple(std::forward<KK>(k)),
+                              forward_as_tuple(std::forward<Args>(args)...));
+        } else {
+            target->move_to_back(slot);
+        }
+        commit(fresh);
+        isTaken = false;
+        return newElem;
+    }
+
+    template <class T, class Q, class = void>
+    struct is_transparent : false_type {};
+
+    template <class T, class Q>
+    struct is_transparent<T, Q, void_t<typename T::is_transparent>> : true_type {};
+
+    /* enables lookups by Q instead of K, as in std::unordered_map */
+    template <class Q>
+    using if_transparent = enable_if_t<is_transparent<Hash, Q>::value && is_transparent<KeyEqual, Q>::value>;
+
+    template <class Q>
+    size_t find_slot(Q const &k) const
+    {
+        return body ? body->find(k, body->hasher(k)) : npos;
+    }
+
+    /* how many keys ahead contains_many and find_many hash and prefetch,
+     * hashing and prefetching whole batches before resolving them
+     * measured slower than this
+     */
+    static constexpr size_t lookupAhead = 8;
+
+    /* calls found with the slot of every key of [first, last) in turn,
+     * npos for a missing one, the key lookupAhead places further is
+     * hashed and its first group prefetched meanwhile
+     */
+    template <class ForwardIt, class Found>
+    void lookup_all(ForwardIt first, ForwardIt last, Found found) const
+    {
+        storage const *s = body.get();
+        if (!s) {
+            for (; first != last; ++first) {
+                found(npos);
+            }
+            return;
+        }
+        size_t hashes[lookupAhead];
+        ForwardIt ahead = first;
+        for (size_t n = 0; n < lookupAhead && ahead != last; ++ahead, ++n) {
+            hashes[n] = s->hasher(*ahead);
+            s->prefetch_group(hashes[n]);
+        }
+        for (size_t i = 0; first != last; ++first, i = (i + 1) % lookupAhead) {
+            size_t h = hashes[i];
+            if (ahead != last) {
+                hashes[i] = s->hasher(*ahead);
+                s->prefetch_group(hashes[i]);
+                ++ahead;
+            }
+            found(s->find(*first, h));
+        }
+    }
+
+    template <class Q>
+    void erase_impl(Q const &k)
+    {
+        erase_hashed_impl(body ? body->hasher(k) : 0, k);
+    }
+
+    /* erase_impl for a key whose hash h is already known */
+    template <class Q>
+    void erase_hashed_impl(size_t h, Q const &k)
+    {
+        size_t c = body ? body->find_cell(k, h) : npos;
+        if (c == npos) {
+            throw lookup_error();
+        }
+        ref fresh;
+        storage *target = writable(fresh);
+        size_t slot = target->slot_of(c);
+        if (target->compact_for_erase(slot, maxFree)) {
+            c = target->cell_of(slot);
+        }
+        target->erase_cell(c);
+        commit(fresh);
+        isTaken = false;
+    }
+
+    template <class Q>
+    node_handle extract_impl(Q const &k)
+    {
+        node_handle nh;
+        size_t c = body ? body->find_cell(k, body->hasher(k)) : npos;
+        if (c == npos) {
+            return nh;
+        }
+        ref fresh;
+        storage *target = writable(fresh);
+        size_t slot = target->slot_of(c);
+        target->prepare_erase(slot);
+        node &n = target->node_at(slot);
+        nh.alloc.emplace(target->alloc);
+        allocator_traits<Allocator>::construct(*nh.alloc, &nh.kv(), move_if_noexcept(n.kv()));
+        nh.hash = n.hash;
+        nh.full = true;
+        nh.hashed = true;
+        target->erase_cell(c);
+        commit(fresh);
+        isTaken = false;
+        return nh;
+    }
+
+    /* the value of the entry in slot, which may then be written to */
+    V &take(size_t slot)
+    {
+        ref fresh;
+        storage *target = writable(fresh);
+        target->own(slot);
+        commit(fresh);
+        isTaken = true;
+        return target->node_at(slot).kv().second;
+    }
+
+    template <class Q>
+    V *try_get_impl(Q const &k)
+    {
+        size_t slot = find_slot(k);
+        return slot == npos ? nullptr : &take(slot);
+    }
+
+    template <class Q>
+    V const *try_get_impl(Q const &k) const
+    {
+        size_t slot = find_slot(k);
+        return slot == npos ? nullptr : &body->node_at(slot).kv().second;
+    }
+
+    /* try_get_impl for a key whose hash h is already known */
+    V const *try_get_hashed_impl(size_t h, K const &k) const
+    {
+        size_t slot = body ? body->find(k, h) : npos;
+        return slot == npos ? nullptr : &body->node_at(slot).kv().second;
+    }
+
+    /* moves the present key k, of hash h, to the end as insert() does,
+     * then lets restamp, which must not throw, write to its value
+     * returns false, changing nothing, when k is absent
+     * no reference to the value escapes, so the map is not marked taken
+     * and its copies keep sharing its storage
+     */
+    template <class F>
+    bool restamp_hashed_impl(size_t h, K const &k, F const &restamp)
+    {
+        size_t slot = body ? body->find(k, h) : npos;
+        if (slot == npos) {
+            return false;
+        }
+        ref fresh;
+        storage *target = writable(fresh);
+        target->move_to_back(slot);
+        target->own(slot);
+        restamp(target->node_at(slot).kv().second);
+        commit(fresh);
+        return true;
+    }
+
+    template <class Q>
+    V &at_impl(Q const &k)
+    {
+        V *v = try_get_impl(k);
+        if (v == nullptr) {
+            throw lookup_error();
+        }
+        return *v;
+    }
+
+    template <class Q>
+    V const &at_impl(Q const &k) const
+    {
+        V const *v = try_get_impl(k);
+        if (v == nullptr) {
+            throw lookup_error();
+        }
+        return *v;
+    }
+
+    /* iterators over pairs, insert("a", "b") must not be taken for a range */
+    template <class It>
+    using if_iterator = enable_if_t<is_class<typename iterator_traits<It>::value_type>::value>;
+
+    /* entries a range will add at most, 0 when it can be walked only once */
+    template <class It>
+    static size_t expected_count(It first, It last)
+    {
+        using category = typename iterator_traits<It>::iterator_category;
+        if (is_base_of<forward_iterator_tag, category>::value) {
+            return static_cast<size_t>(distance(first, last));
+        }
+        return 0;
+    }
+
+    /* hash of the key it points to, taken from the source map when
+     * the range comes from one and cached hashes carry over
+     */
+    template <class It>
+    static size_t hash_at(It const &it, storage const *target, K const &k)
+    {
+        if constexpr (is_same<It, iterator>::value && statelessKeys) {
+            return it.s->node_at(it.slot).hash;
+        } else {
+            (void)it;
+            return target->hasher(k);
+        }
+    }
+
+    /* one step of a batch insert: slot was appended or, when added is
+     * false, moved to the back from its place right after prev
+     * merge(&&) keeps in prev of an appended entry its slot in the source
+     */
+    struct change {
+        size_t slot;
+        size_t prev;
+        bool added;
+    };
+
+    template <class Log>
+    static void undo(storage *target, Log const &log) noexcept
+    {
+        for (auto it = log.rbegin(); it != log.rend(); ++it) {
+            if (it->added) {
+                target->erase_cell(target->cell_of(it->slot));
+            } else {
+                target->relink_after(it->slot, it->prev);
+            }
+        }
+    }
+
+    /* inserts the pairs of [first, last) in order, as if by insert(),
+     * sharing one detach, one reserve and one try block
+     * a private copy is simply dropped on failure, a storage written
+     * in place is restored by undoing the logged changes backwards
+     */
+    template <class It>
+    void insert_range(It first, It last)
+    {
+        size_t expected = expected_count(first, last);
+        ref fresh;
+        storage *target = writable(fresh, size() + expected);
+        bool inPlace = !fresh;
+        vector<change, alloc_of<change>> log(alloc_of<change>(target->alloc));
+        if (inPlace) {
+            log.reserve(expected);
+        }
+        target->reserve(target->count + expected);
+        try {
+            for (; first != last; ++first) {
+                auto &&e = *first;
+                K const &k = e.first;
+                size_t h = hash_at(first, target, k);
+                size_t slot = target->find(k, h);
+                if (slot != npos && slot == target->tail) {
+                    continue;
+                }
+                if (slot != npos) {
+                    if (inPlace) {
+                        log.push_back(change{slot, target->node_at(slot).prev, false});
+                    }
+                    target->move_to_back(slot);
+                    continue;
+                }
+                target->reserve_one();
+                slot = target->construct(piecewise_construct,
+                                         forward_as_tuple(get<0>(std::forward<decltype(e)>(e))),
+                                         forward_as_tuple(get<1>(std::forward<decltype(e)>(e))));
+                if (inPlace) {
+                    try {
+                        log.push_back(change{slot, npos, true});
+                    } catch (...) {
+                        target->destroy_at(slot);
+                        throw;
+                    }
+                }
+                target->adopt(slot, h);
+            }
+        } catch (...) {
+            undo(target, log);
+            throw;
+        }
+        commit(fresh);
+        isTaken = false;
+    }
+
+    /* hashes cached by one map are valid in another one only when
+     * hashing and comparing keys does not depend on the functor objects
+     */
+    static constexpr bool statelessKeys = is_empty<Hash>::value && is_empty<KeyEqual>::value;
+
+    /* the allocator of this map is that of its storage, if it has one */
+    bool same_allocator(storage const &other) const noexcept
+    {
+        return allocator_traits<Allocator>::is_always_equal::value || fn.alloc() == other.alloc;
+    }
+
+    /* below this many entries merge_all does not start threads by itself */
+    static constexpr size_t parallelThreshold = 1 << 15;
+
+    /* partition of a mixed hash, taken from its top bits, which neither
+     * ctrl nor the probe start depend on
+     */
+    static size_t part_of(size_t mixed, size_t parts) noexcept
+    {
+        return ((mixed >> (numeric_limits<size_t>::digits - 8)) * parts) >> 8;
+    }
+
+    /* runs f(part) for every part below parts, part 0 on this thread and
+     * each other one on a thread of its own, and once all have finished
+     * rethrows the exception of the lowest part that threw
+     */
+    template <class F>
+    static void for_each_part(size_t parts, F const &f)
+    {
+        vector<exception_ptr> errors(parts);
+        auto work = [&](size_t part) {
+            try {
+                f(part);
+            } catch (...) {
+                errors[part] = current_exception();
+            }
+        };
+        vector<thread> pool;
+        try {
+            pool.reserve(parts - 1);
+            for (size_t part = 1; part < parts; part++) {
+                pool.emplace_back(work, part);
+            }
+        } catch (...) {
+            for (thread &t : pool) {
+                t.join();
+            }
+            throw;
+        }
+        work(0);
+        for (thread &t : pool) {
+            t.join();
+        }
+        for (exception_ptr const &e : errors) {
+            if (e) {
+                rethrow_exception(e);
+            }
+        }
+    }
+
+    /* a key dedup_part has met, at the positions of its first and last entry */
+    struct seen {
+        size_t first;
+        size_t last;
+    };
+
+    /* working memory of dedup_part, from the map's allocator
+     * memory resources need not be thread-safe, so for a part run on
+     * another thread it is reserved beforehand, for all n positions of
+     * the part, on the calling thread, and dedup_part never allocates
+     */
+    struct dedup_scratch {
+        static constexpr size_t firstTable = 64;
+
+        vector<seen, alloc_of<seen>> keys;
+        vector<size_t, alloc_of<size_t>> table;
+
+        explicit dedup_scratch(Allocator const &a) : keys(alloc_of<seen>(a)), table(alloc_of<size_t>(a))
+        {}
+
+        void reserve(size_t n)
+        {
+            size_t cells = firstTable;
+            while (cells < n * 2) {
+                cells *= 2;
+            }
+            keys.reserve(n);
+            table.reserve(cells);
+        }
+    };
+
+    /* finds the keys among the entries of order at positions position(i)
+     * for i in [first, last), increasing with i, and for each records in
+     * pick, at the position of its last entry, the position of its first one
+     * returns how many keys it found
+     */
+    template <class Order, class Position, class Picks>
+    static size_t dedup_part(Order const &order, Position const &position, size_t first, size_t last,
+                             Picks &pick, dedup_scratch &scratch)
+    {
+        KeyEqual equal;
+        auto &keys = scratch.keys;
+        auto &table = scratch.table;
+        table.assign(dedup_scratch::firstTable, npos);
+        for (; first != last; ++first) {
+            size_t pos = position(first);
+            node const &n = *order[pos];
+            size_t mask = table.size() - 1;
+            size_t c = (storage::mix(n.hash) >> 7) & mask;
+            for (; table[c] != npos; c = (c + 1) & mask) {
+                seen &k = keys[table[c]];
+                node const &m = *order[k.first];
+                if (m.hash == n.hash && equal(m.kv().first, n.kv().first)) {
+                    k.last = pos;
+                    break;
+                }
+            }
+            if (table[c] != npos) {
+                continue;
+            }
+            keys.push_back(seen{pos, pos});
+            table[c] = keys.size() - 1;
+            if (keys.size() * 2 > table.size()) {
+                table.assign(table.size() * 2, npos);
+                mask = table.size() - 1;
+                for (size_t j = 0; j < keys.size(); j++) {
+                    size_t d = (storage::mix(order[keys[j].first]->hash) >> 7) & mask;
+                    while (table[d] != npos) {
+                        d = (d + 1) & mask;
+                    }
+                    table[d] = j;
+                }
+            }
+        }
+        for (seen const &k : keys) {
+            pick[k.last] = k.first;
+        }
+        return keys.size();
+    }
+
+    /* dedup_part for each of parts parts of the hash space on a thread of
+     * its own, each thread first takes a slice of order and lays out its
+     * positions by part, so that every part is one run, in order, of
+     * scattered, and every entry is read by one thread only
+     */
+    template <class Order, class Picks, class Counts>
+    static void dedup_parallel(Order const &order, size_t parts, Picks &pick, Counts &found,
+                               Allocator const &a)
+    {
+        size_t total = order.size();
+        auto slice = [total, parts](size_t t) { return total / parts * t + min(t, total % parts); };
+        vector<unsigned char, alloc_of<unsigned char>> partition(total, 0, alloc_of<unsigned char>(a));
+        vector<size_t, alloc_of<size_t>> offsets(parts * parts, 0, alloc_of<size_t>(a));
+        for_each_part(parts, [&](size_t t) {
+            for (size_t pos = slice(t); pos < slice(t + 1); pos++) {
+                size_t part = part_of(storage::mix(order[pos]->hash), parts);
+                partition[pos] = static_cast<unsigned char>(part);
+                offsets[t * parts + part]++;
+            }
+        });
+        vector<size_t, alloc_of<size_t>> runs(parts + 1, 0, alloc_of<size_t>(a));
+        size_t start = 0;
+        for (size_t part = 0; part < parts; part++) {
+            runs[part] = start;
+            for (size_t t = 0; t < parts; t++) {
+                size_t n = offsets[t * parts + part];
+                offsets[t * parts + part] = start;
+                start += n;
+            }
+        }
+        runs[parts] = total;
+        vector<size_t, alloc_of<size_t>> scattered(total, 0, alloc_of<size_t>(a));
+        for_each_part(parts, [&](size_t t) {
+            size_t *next = &offsets[t * parts];
+            for (size_t pos = slice(t); pos < slice(t + 1); pos++) {
+                scattered[next[partition[pos]]++] = pos;
+            }
+        });
+        vector<dedup_scratch, alloc_of<dedup_scratch>> scratch{alloc_of<dedup_scratch>(a)};
+        scratch.reserve(parts);
+        for (size_t part = 0; part < parts; part++) {
+            scratch.emplace_back(a);
+            scratch.back().reserve(runs[part + 1] - runs[part]);
+        }
+        auto position = [&scattered](size_t i) { return scattered[i]; };
+        for_each_part(parts, [&](size_t part) {
+            found[part] = dedup_part(order, position, runs[part], runs[part + 1], pick, scratch[part]);
+        });
+    }
+
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = pair<K, V>;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using allocator_type = Allocator;
+    using node_type = node_handle;
+
+    ~insertion_ordered_map() noexcept = default;
+
+    insertion_ordered_map() noexcept(lazyStorage && nothrowFunctors &&
+                                     is_nothrow_default_constructible<Allocator>::value) :
+            insertion_ordered_map(Allocator())
+    {}
+
+    explicit insertion_ordered_map(Allocator const &a) noexcept(lazyStorage && nothrowFunctors) :
+            fn(a, Hash(), KeyEqual())
+    {
+        if (!lazyStorage) {
+            body = ref(fn.make_storage());
+        }
+    }
+
+    /* empty map with room for n entries */
+    explicit insertion_ordered_map(size_t n, Allocator const &a = Allocator()) : fn(a, Hash(), KeyEqual())
+    {
+        body = ref(fn.make_storage());
+        body->reserve(n);
+    }
+
+    /* map holding the pairs of [first, last), a key repeated later
+     * in the range is placed where it occurs last
+     */
+    template <class InputIt, class = if_iterator<InputIt>>
+    insertion_ordered_map(InputIt first, InputIt last, Allocator const &a = Allocator()) :
+            insertion_ordered_map(a)
+    {
+        insert_range(first, last);
+    }
+
+    insertion_ordered_map(initializer_list<value_type> il, Allocator const &a = Allocator()) :
+            insertion_ordered_map(a)
+    {
+        insert_range(il.begin(), il.end());
+    }
+
+    insertion_ordered_map(insertion_ordered_map const &other) :
+            body(other.body), fn(other.fn), maxFree(other.maxFree)
+    {
+        if (other.isTaken) {
+            body = ref(storage::make(other.body->alloc, deep_copy_t(), *other.body));
+        }
+    }
+
+    /* other keeps its allocator and functors, as standard containers do */
+    insertion_ordered_map(insertion_ordered_map&& other) noexcept(nothrowFunctors) :
+            body(move(other.body)),
+            isTaken(other.isTaken),
+            fn(other.fn),
+            maxFree(other.maxFree)
+    {
+        other.isTaken = false;
+    }
+
+    insertion_ordered_map& operator=(insertion_ordered_map other) noexcept(nothrowFunctors)
+    {
+        fn.replace(other.fn);
+        body = move(other.body);
+        // other was moved from a map that may have handed out references
+        isTaken = other.isTaken;
+        maxFree = other.maxFree;
+        return *this;
+    }
+
+    /* if key k already exists it is moved to the end of the
+     * iteration order and its value is left untouched,
+     * otherwise (k, v) is appended
+     * returns whether k was new
+     */
+    bool insert(K const &k, V const &v)
+    {
+        return insert_impl(k, v);
+    }
+
+    bool insert(K &&k, V &&v)
+    {
+        return insert_impl(move_if_movable(k), move_if_movable(v));
+    }
+
+    /* a key kept by the caller does not make the value be copied */
+    bool insert(K const &k, V &&v)
+    {
+        return insert_impl(k, move_if_movable(v));
+    }
+
+    bool insert(K &&k, V const &v)
+    {
+        return insert_impl(move_if_movable(k), v);
+    }
+
+    /* insert for a caller that already hashed k, h must be the value
+     * Hash gives for k, nothing in the map hashes k again
+     */
+    bool insert_hashed(size_t h, K const &k, V const &v)
+    {
+        return insert_hashed_impl(h, k, v);
+    }
+
+    bool insert_hashed(size_t h, K &&k, V &&v)
+    {
+        return insert_hashed_impl(h, move_if_movable(k), move_if_movable(v));
+    }
+
+    bool insert_hashed(size_t h, K const &k, V &&v)
+    {
+        return insert_hashed_impl(h, k, move_if_movable(v));
+    }
+
+    bool insert_hashed(size_t h, K &&k, V const &v)
+    {
+        return insert_hashed_impl(h, move_if_movable(k), v);
+    }
+
+    /* inserts every pair of [first, last) in order, as repeated insert()
+     * calls would, but either all of them or, on an exception, none
+     * the range must not come from this map
+     */
+    template <class InputIt, class = if_iterator<InputIt>>
+    void insert(InputIt first, InputIt last)
+    {
+        insert_range(first, last);
+    }
+
+    void insert(initializer_list<value_type> il)
+    {
+        insert_range(il.begin(), il.end());
+    }
+
+    /* like insert, but the value is built from args in place
+     * and only if k is new
+     */
+    template <class... Args>
+    bool try_emplace(K const &k, Args &&... args)
+    {
+        return insert_impl(k, std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    bool try_emplace(K &&k, Args &&... args)
+    {
+        return insert_impl(move_if_movable(k), std::forward<Args>(args)...);
+    }
+
+    /* builds the entry from args in place, then behaves like insert,
+     * the entry is dropped if its key is already present
+     */
+    template <class... Args>
+    bool emplace(Args &&... args)
+    {
+        ref fresh;
+        storage *target = writable(fresh, size() + 1);
+        target->reserve_one();
+        size_t slot = target->construct(std::forward<Args>(args)...);
+        size_t h;
+        size_t old;
+        try {
+            K const &k = target->node_at(slot).kv().first;
+            h = target->hasher(k);
+            old = target->find(k, h);
+        } catch (...) {
+            target->destroy_at(slot);
+            throw;
+        }
+        if (old != npos) {
+            target->destroy_at(slot);
+            target->move_to_back(old);
+        } else {
+            target->adopt(slot, h);
+        }
+        commit(fresh);
+        isTaken = false;
+        return old == npos;
+    }
+
+    /* takes the entry of k out of the map, an empty handle if k is absent */
+    node_type extract(K const &k)
+    {
+        return extract_impl(k);
+    }
+
+    template <class Q, class = if_transparent<Q>>
+    node_type extract(Q const &k)
+    {
+        return extract_impl(k);
+    }
+
+    /* links the entry held by nh into the map unless its key is present
+     * already, in which case that key is moved to the end as by insert()
+     * and nh keeps the entry
+     * returns whether the entry was taken
+     */
+    bool insert(node_type &&nh)
+    {
+        if (nh.empty()) {
+            return false;
+        }
+        K const &k = nh.kv().first;
+        bool cached = statelessKeys && nh.hashed;
+        size_t h = 0;
+        size_t slot = npos;
+        if (body) {
+            h = cached ? nh.hash : body->hasher(k);
+            slot = body->find(k, h);
+            if (slot != npos && slot == body->tail) {
+                return false;
+            }
+        }
+        ref fresh;
+        storage *target = writable(fresh, slot == npos ? size() + 1 : 0);
+        if (!body) {
+            h = cached ? nh.hash : target->hasher(k);
+        }
+        bool newElem = (slot == npos);
+        if (newElem) {
+            target->reserve_one();
+            target->push_back(h, move_if_noexcept(nh.kv()));
+            nh.reset();
+        } else {
+            target->move_to_back(slot);
+        }
+        commit(fresh);
+        isTaken = false;
+        return newElem;
+    }
+
+    void erase(K const &k)
+    {
+        erase_impl(k);
+    }
+
+    template <class Q, class = if_transparent<Q>>
+    void erase(Q const &k)
+    {
+        erase_impl(k);
+    }
+
+    /* inserts the entries of other in their order, as insert() would,
+     * all of them or none
+     * only the changes made are logged for rollback, so the cost
+     * follows other.size() rather than size()
+     */
+    void merge(insertion_ordered_map const &other)
+    {
+        // a map merged with itself, or with a copy sharing its storage, stays as it is
+        if (other.body != body) {
+            insert_range(other.begin(), other.end());
+        }
+    }
+
+    /* like merge(other), but entries new to this map are moved out of
+     * other, with their cached hashes, instead of being copied
+     * entries whose keys this map already holds stay in other
+     * all entries or none are moved, an empty map simply takes over
+     * the storage of other
+     * besides room for the new entries, one rollback log of up to
+     * other.size() steps is allocated
+     */
+    void merge(insertion_ordered_map &&other)
+    {
+        if (&other == this || other.empty() || other.body == body) {
+            return;
+        }
+        if (empty() && statelessKeys && other.body.unique() && same_allocator(*other.body)) {
+            std::swap(body, other.body);
+            isTaken = other.isTaken;
+            other.isTaken = false;
+            return;
+        }
+        ref mine;
+        ref theirs;
+        storage *target = writable(mine, size() + other.size());
+        storage *source = other.writable(theirs);
+        target->reserve(target->count + source->count);
+        vector<change, alloc_of<change>> log(alloc_of<change>(target->alloc));
+        log.reserve(source->count);
+        bool inPlace = !mine;
+        try {
+            for (size_t i = source->head; i != npos; i = source->node_at(i).next) {
+                pair<K,V> const &kv = source->node_at(i).kv();
+                size_t h = statelessKeys ? source->node_at(i).hash : target->hasher(kv.first);
+                size_t slot = target->find(kv.first, h);
+                if (slot == npos) {
+                    target->reserve_one();
+                    source->prepare_erase(i);
+                    slot = target->construct(move_if_noexcept(source->node_at(i).kv()));
+                    target->adopt(slot, h);
+                    log.push_back(change{slot, i, true});
+                } else if (slot != target->tail) {
+                    log.push_back(change{slot, target->node_at(slot).prev, false});
+                    target->move_to_back(slot);
+                }
+            }
+        } catch (...) {
+            // entries moved out of other go back before this map drops them
+            for (auto it = log.rbegin(); it != log.rend(); ++it) {
+                if (it->added && is_nothrow_move_constructible<pair<K,V>>::value) {
+                    source->destroy_at(it->prev);
+                    source->construct_at(it->prev, move_if_noexcept(target->node_at(it->slot).kv()));
+                }
+            }
+            if (inPlace) {
+                undo(target, log);
+            }
+            throw;
+        }
+        for (change const &c : log) {
+            if (c.added) {
+                source->erase_cell(source->cell_of(c.prev));
+            }
+        }
+        commit(mine);
+        other.commit(theirs);
+        isTaken = false;
+        other.isTaken = false;
+    }
+
+    /* merges all maps of [first, last) in turn, with the same result
+     * as calling merge() for each of them, but in one pass: this thread
+     * lists the entries in order, up to threads threads sort a slice of
+     * the list each by part of the hash space, then deduplicate the keys
+     * of a part each by their cached hashes, and the surviving entries
+     * are copied once in their final order
+     * threads == 0 picks thread::hardware_concurrency() for large inputs
+     * hashes cached by different maps are comparable only for stateless
+     * Hash and KeyEqual, with other ones the maps are merged one by one
+     * all maps or none are merged
+     */
+    template <class InputIt, class = if_iterator<InputIt>>
+    void merge_all(InputIt first, InputIt last, size_t threads = 0)
+    {
+        if (!statelessKeys) {
+            insertion_ordered_map result(*this);
+            for (; first != last; ++first) {
+                result.merge(&*first == this ? result : *first);
+            }
+            *this = move(result);
+            return;
+        }
+        Allocator a = get_allocator();
+        vector<storage const *, alloc_of<storage const *>> sources{alloc_of<storage const *>(a)};
+        size_t total = 0;
+        if (body) {
+            sources.push_back(body.get());
+            total += body->count;
+        }
+        for (; first != last; ++first) {
+            // merging this map with itself changes nothing at any point
+            storage const *s = first->body.get();
+            if (&*first != this && s != nullptr && s->count != 0) {
+                sources.push_back(s);
+                total += s->count;
+            }
+        }
+        if (total == size()) {
+            return;
+        }
+
+        size_t parts = threads;
+        if (parts == 0) {
+            parts = total < parallelThreshold ? 1 : max<size_t>(thread::hardware_concurrency(), 1);
+        }
+        parts = min<size_t>(parts, 256);
+
+        // the entries in their final order, before deduplication
+        vector<node const *, alloc_of<node const *>> order{alloc_of<node const *>(a)};
+        order.reserve(total);
+        for (storage const *s : sources) {
+            for (size_t i = s->head; i != npos; i = s->node_at(i).next) {
+                order.push_back(&s->node_at(i));
+            }
+        }
+
+        vector<size_t, alloc_of<size_t>> pick(total, npos, alloc_of<size_t>(a));
+        vector<size_t, alloc_of<size_t>> found(parts, 0, alloc_of<size_t>(a));
+        if (parts == 1) {
+            dedup_scratch scratch(a);
+            found[0] = dedup_part(order, [](size_t i) { return i; }, 0, total, pick, scratch);
+        } else {
+            dedup_parallel(order, parts, pick, found, a);
+        }
+        size_t survivors = 0;
+        for (size_t n : found) {
+            survivors += n;
+        }
+
+        ref fresh(fn.make_storage());
+        fresh->reserve(survivors);
+        for (size_t pos = 0; pos < total; pos++) {
+            if (pick[pos] != npos) {
+                node const *n = order[pick[pos]];
+                fresh->push_back(n->hash, n->kv());
+            }
+        }
+        commit(fresh);
+        isTaken = false;
+    }
+
+    template <class Range>
+    void merge_all(Range const &maps, size_t threads = 0)
+    {
+        merge_all(std::begin(maps), std::end(maps), threads);
+    }
+
+    V &at(K const &k)
+    {
+        return at_impl(k);
+    }
+
+    template <class Q, class = if_transparent<Q>>
+    V &at(Q const &k)
+    {
+        return at_impl(k);
+    }
+
+    V const &at(K const &k) const
+    {
+        return at_impl(k);
+    }
+
+    template <class Q, class = if_transparent<Q>>
+    V const &at(Q const &k) const
+    {
+        return at_impl(k);
+    }
+
+    template <class VV = V, typename = std::enable_if_t<is_default_constructible<VV>::value>>
+    V &operator[](K const &k){
+        // the key is hashed and looked up once, a miss goes straight to insertion
+        bool hashed = static_cast<bool>(body);
+        size_t h = hashed ? body->hasher(k) : 0;
+        size_t slot = hashed ? body->find(k, h) : npos;
+        if (slot != npos) {
+            return take(slot);
+        }
+        ref fresh;
+        storage *target = writable(fresh, size() + 1);
+        target->reserve_one();
+        slot = target->push_back(hashed ? h : target->hasher(k), k, V());
+        commit(fresh);
+        isTaken = true;
+        return target->node_at(slot).kv().second;
+    }
+
+    /* copies of a map keep using the allocator of the map they come from */
+    Allocator get_allocator() const noexcept
+    {
+        return fn.alloc();
+    }
+
+    size_t size() const noexcept
+    {
+        return body ? body->count : 0;
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    void clear() noexcept(lazyStorage)
+    {
+        if (body && body.unique()) {
+            body->clear();
+        } else if (lazyStorage) {
+            body = ref();
+        } else {
+            body = ref(fn.make_storage());
+        }
+        isTaken = false;
+    }
+
+    /* makes room for n entries in total, so that inserting up to
+     * n entries neither grows the storage nor rehashes the index
+     */
+    void reserve(size_t n)
+    {
+        ref fresh;
+        storage *target = writable(fresh, n);
+        target->reserve(n);
+        commit(fresh);
+    }
+
+    /* sets the index to at least n cells, never fewer than it needs
+     * for the entries held
+     */
+    void rehash(size_t n)
+    {
+        ref fresh;
+        storage *target = writable(fresh);
+        size_t groupCount = 0;
+        if (n > 0) {
+            groupCount = 1;
+            while (groupCount * group::width < n) {
+                groupCount *= 2;
+            }
+        }
+        target->resize_index(groupCount);
+        commit(fresh);
+    }
+
+    /* gives back memory left over after erasing, entries are packed
+     * in iteration order and the index gets its smallest fitting size
+     */
+    void shrink_to_fit()
+    {
+        ref fresh;
+        storage *target = writable(fresh);
+        target->shrink_to_fit();
+        commit(fresh);
+    }
+
+    /* entries the map holds without growing its storage or its index */
+    size_t capacity() const noexcept
+    {
+        if (!body) {
+            return 0;
+        }
+        return min(body->capacity, body->groups ? body->cells() * 7 / 8 : storage::smallLimit);
+    }
+
+    size_t bucket_count() const noexcept
+    {
+        return body ? body->cells() : 0;
+    }
+
+    float load_factor() const noexcept
+    {
+        size_t cells = bucket_count();
+        return cells == 0 ? 0.0f : static_cast<float>(size()) / static_cast<float>(cells);
+    }
+
+    float max_load_factor() const noexcept
+    {
+        return 7.0f / 8.0f;
+    }
+
+    /* erasing packs the entries in iteration order once more than this
+     * share of the slots handed out has been freed, which keeps a long
+     * churn from scattering iteration over memory, amortized O(1)
+     * as packing n entries takes n erasures to come due again
+     */
+    float max_free_fraction() const noexcept
+    {
+        return maxFree;
+    }
+
+    /* 1 turns packing off, throws invalid_argument unless 0 < fraction <= 1,
+     * as with 0 every erasure would pack
+     */
+    void max_free_fraction(float fraction)
+    {
+        if (!(fraction > 0.0f && fraction <= 1.0f)) {
+            throw invalid_argument("insertion_ordered_map max_free_fraction out of (0, 1]");
+        }
+        maxFree = fraction;
+    }
+
+    bool contains(K const &k) const
+    {
+        return find_slot(k) != npos;
+    }
+
+    template <class Q, class = if_transparent<Q>>
+    bool contains(Q const &k) const
+    {
+        return find_slot(k) != npos;
+    }
+
+    /* writes contains(k) for every key k of [first, last) to out, in
+     * order, each key is hashed and its index group prefetched a few
+     * lookups ahead, so that misses of maps larger than the cache overlap
+     * returns out past the last value written
+     */
+    template <class ForwardIt, class OutputIt>
+    OutputIt contains_many(ForwardIt first, ForwardIt last, OutputIt out) const
+    {
+        lookup_all(first, last, [&out](size_t slot) {
+            *out = slot != npos;
+            ++out;
+        });
+        return out;
+    }
+
+    /* like contains_many, but writes a pointer to the value of each key,
+     * nullptr for a missing one
+     */
+    template <class ForwardIt, class OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const
+    {
+        storage const *s = body.get();
+        lookup_all(first, last, [&out, s](size_t slot) {
+            *out = slot == npos ? nullptr : &s->node_at(slot).kv().second;
+            ++out;
+        });
+        return out;
+    }
+
+    /* a pointer to the value of k, or nullptr when there is none,
+     * the non-const overloads copy shared storage as at() does
+     */
+    V *try_get(K const &k)
+    {
+        return try_get_impl(k);
+    }
+
+    template <class Q, class = if_transparent<Q>>
+    V *try_get(Q const &k)
+    {
+        return try_get_impl(k);
+    }
+
+    V const *try_get(K const &k) const
+    {
+        return try_get_impl(k);
+    }
+
+    template <class Q, class = if_transparent<Q>>
+    V const *try_get(Q const &k) const
+    {
+        return try_get_impl(k);
+    }
+
+    class iterator {
+    private:
+        const storage *s = nullptr;
+        size_t slot = npos;
+
+        friend class insertion_ordered_map;
+
+        iterator(const storage *st, size_t sl) noexcept : s(st), slot(sl)
+        {}
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = pair<K,V>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const pair<K,V> *;
+        using reference = const pair<K,V> &;
+
+        ~iterator() noexcept = default;
+        iterator() noexcept = default;
+        iterator(const iterator &other) noexcept = default;
+        iterator& operator=(const iterator& other) noexcept = default;
+
+        const pair<K,V>& operator*() const noexcept
+        {
+            return s->node_at(slot).kv();
+        }
+
+        const pair<K,V>* operator->() const noexcept
+        {
+            return &s->node_at(slot).kv();
+        }
+
+        iterator& operator++() noexcept
+        {
+            slot = s->node_at(slot).next;
+            return *this;
+        }
+
+        bool operator==(const iterator& b) const noexcept
+        {
+            return slot == b.slot && (slot == npos || s == b.s);
+        }
+
+        bool operator!=(const iterator& b) const noexcept
+        {
+            return !(*this == b);
+        }
+
+    };
+
+    iterator begin() const noexcept
+    {
+        return iterator(body.get(), body ? body->head : npos);
+    }
+
+    iterator end() const noexcept
+    {
+        return iterator(body.get(), npos);
+    }
+
+    /* the entry of k, or end() when there is none */
+    iterator find(K const &k) const
+    {
+        return iterator(body.get(), find_slot(k));
+    }
+
+    template <class Q, class = if_transparent<Q>>
+    iterator find(Q const &k) const
+    {
+        return iterator(body.get(), find_slot(k));
+    }
+
+    /* erases the entry pos points to, which must be one of this map,
+     * it is found in the index by its cached hash, without hashing or
+     * comparing keys
+     * returns an iterator to the entry that followed it
+     */
+    iterator erase(iterator pos)
+    {
+        ref fresh;
+        storage *target = writable(fresh);
+        size_t slot = pos.slot;
+        target->compact_for_erase(slot, maxFree);
+        size_t next = target->node_at(slot).next;
+        target->erase_cell(target->cell_of(slot));
+        commit(fresh);
+        isTaken = false;
+        return iterator(body.get(), next);
     }
 };
 
-template <class K, class V, class Hash = std::hash<K>>
-class insertion_ordered_map {
+/* holds the current version of a map for one writer and many readers
+ * readers take a copy of it, which costs a few atomic operations, never
+ * blocks and stays unchanged whatever the writer publishes later
+ * a published version is freed once no reader can still be copying it,
+ * readers announce themselves in one of two counters picked by the
+ * parity of epoch, and the writer, serialized by a mutex, drains both
+ * around flipping it
+ */
+template <class Map>
+class snapshot_cell {
 private:
-    /* creates new map with actual objects (list::iterator)
-     * need to have current attr pairs
-     */
-    shared_ptr<unordered_map<K,typename list<pair<K,V>>::iterator, Hash>> my_make_shared(){
-        auto newMap = make_shared<unordered_map<K,typename list<pair<K,V>>::iterator, Hash>>();
-        for(auto it = pairs->begin();it != pairs->end();++it){
-            newMap->insert({it->first, it});
+    struct version {
+        Map map;
+    };
+
+    atomic<version *> current;
+    mutable atomic<size_t> readers[2] = {};
+    atomic<size_t> epoch{0};
+    mutex writer;
+
+    class reading {
+    private:
+        atomic<size_t> &counter;
+
+    public:
+        explicit reading(atomic<size_t> &c) noexcept : counter(c)
+        {
+            counter.fetch_add(1);
+        }
+
+        ~reading() noexcept
+        {
+            counter.fetch_sub(1);
         }
-        return newMap;
+    };
+
+    /* the map of a version is reached only through copies, so no
+     * reference into it taken before it was installed may be written
+     * through any more, and copies may share its storage even when it
+     * was marked taken
+     */
+    static version *make_version(Map &&m)
+    {
+        version *fresh = new version{move(m)};
+        fresh->map.isTaken = false;
+        return fresh;
     }
 
-    shared_ptr<list<pair<K,V>>> my_make_shared_list(){
-        auto l = make_shared<list<pair<K,V>>>();
-        for (auto it = pairs->begin();it != pairs->end();++it){
-            l->push_back({it->first, it->second});
+    void drain(size_t parity) const noexcept
+    {
+        while (readers[parity].load() != 0) {
+            this_thread::yield();
         }
-        return l;
     }
+
+    /* installs fresh, frees the version it replaces once no reader holds it */
+    void replace(version *fresh) noexcept
+    {
+        version *old = current.exchange(fresh);
+        // readers that saw the old epoch late may still enter the other counter
+        size_t e = epoch.load();
+        drain((e + 1) & 1);
+        epoch.store(e + 1);
+        drain(e & 1);
+        delete old;
+    }
+
 public:
+    snapshot_cell() : snapshot_cell(Map())
+    {}
 
-    shared_ptr<list<pair<K,V>>> pairs;
-    shared_ptr<unordered_map<K,typename list<pair<K,V>>::iterator, Hash>> map;
-    bool isTaken = false;
-    ~insertion_ordered_map() noexcept = default;
+    explicit snapshot_cell(Map m) : current(make_version(move(m)))
+    {}
+
+    snapshot_cell(snapshot_cell const &) = delete;
+    snapshot_cell &operator=(snapshot_cell const &) = delete;
+
+    ~snapshot_cell() noexcept
+    {
+        delete current.load();
+    }
+
+    /* the map last published, safe to call from any number of threads */
+    Map load() const
+    {
+        reading guard(readers[epoch.load() & 1]);
+        return current.load()->map;
+    }
 
-    insertion_ordered_map() noexcept
+    /* makes m the version returned by later loads, for writer threads */
+    void publish(Map m)
+    {
+        version *fresh = make_version(move(m));
+        lock_guard<mutex> lock(writer);
+        replace(fresh);
+    }
+
+    /* publishes the result of applying f to a copy of the current version,
+     * writers calling update never lose each other's changes
+     */
+    template <class F>
+    void update(F f)
     {
-        pairs = make_shared<list<pair<K,V>>>();
-        map = make_shared<unordered_map<K,typename list<pair<K,V>>::iterator, Hash>>();
+        lock_guard<mutex> lock(writer);
+        Map m = current.load()->map;
+        f(m);
+        replace(make_version(move(m)));
+    }
+};
+
+/* insertion_ordered_map for many threads writing at once
+ * keys are spread by hash over shards, each an insertion_ordered_map
+ * behind its own mutex, and every insert takes a number from one global
+ * sequence, so the entries of all shards can be put back in one order
+ * snapshot() locks all shards at once, copies them, which only shares
+ * their storage, and merges the copies by sequence number
+ * a key is hashed once, the shard map reuses the hash that picked its shard
+ */
+template <class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>,
+          class Allocator = std::allocator<std::pair<K, V>>>
+class concurrent_insertion_ordered_map {
+private:
+    struct stamped {
+        uint64_t seq;
+        V value;
     };
 
-    insertion_ordered_map(insertion_ordered_map const &other)
+    using shard_map = insertion_ordered_map<K, stamped, Hash, KeyEqual,
+            typename allocator_traits<Allocator>::template rebind_alloc<pair<K, stamped>>>;
+
+    struct alignas(64) shard {
+        mutex lock;
+        shard_map map;
+    };
+
+    atomic<uint64_t> sequence{0};
+    size_t shardBits;
+    unique_ptr<shard[]> shards;
+    Hash hasher;
+    Allocator alloc;
+
+    /* top bits of a multiplicative hash, the shard maps index by the low ones */
+    shard &shard_of(size_t h) const noexcept
     {
-        pairs = other.pairs;
-        map = other.map;
-        if(other.isTaken){
-            auto prevPairs = pairs.get();
-            auto prevMap = map.get();
-            try {
-                pairs = my_make_shared_list();
-                map = my_make_shared();
-            } catch (exception& e){
-                pairs.reset(prevPairs);
-                map.reset(prevMap);
-                throw e;
-            }
+        if (shardBits == 0) {
+            return shards[0];
         }
+        uint64_t x = static_cast<uint64_t>(h) * 0x9E3779B97F4A7C15ull;
+        return shards[static_cast<size_t>(x >> (64 - shardBits))];
     }
 
-    insertion_ordered_map(insertion_ordered_map&& other) noexcept :
-            pairs(move(other.pairs)),
-            map(move(other.map)),
-            isTaken(move(other.isTaken))
-    {}
+public:
+    /* shardCount is rounded up to a power of two */
+    explicit concurrent_insertion_ordered_map(size_t shardCount = 64, Allocator const &a = Allocator()) :
+            shardBits(0), alloc(a)
+    {
+        while ((size_t(1) << shardBits) < shardCount) {
+            shardBits++;
+        }
+        shards.reset(new shard[size_t(1) << shardBits]);
+        for (size_t i = 0; i < (size_t(1) << shardBits); i++) {
+            shards[i].map = shard_map(typename shard_map::allocator_type(a));
+        }
+    }
 
-    insertion_ordered_map& operator=(insertion_ordered_map other) noexcept
+    explicit concurrent_insertion_ordered_map(Allocator const &a) :
+            concurrent_insertion_ordered_map(64, a)
+    {
+    }
+
+    Allocator get_allocator() const
+    {
+        return alloc;
+    }
+
+    concurrent_insertion_ordered_map(concurrent_insertion_ordered_map const &) = delete;
+    concurrent_insertion_ordered_map &operator=(concurrent_insertion_ordered_map const &) = delete;
+
+    /* as insertion_ordered_map::insert, a present key is moved to the end */
+    bool insert(K const &k, V const &v)
     {
-        if(this != &other){
-            pairs = other.pairs;
-            map = other.map;
+        size_t h = hasher(k);
+        shard &s = shard_of(h);
+        lock_guard<mutex> guard(s.lock);
+        uint64_t seq = sequence.fetch_add(1, memory_order_relaxed);
+        if (s.map.restamp_hashed_impl(h, k, [seq](stamped &e) noexcept { e.seq = seq; })) {
+            return false;
         }
-        return *this;
+        return s.map.insert_hashed(h, k, stamped{seq, v});
+    }
+
+    /* throws lookup_error if k is absent */
+    void erase(K const &k)
+    {
+        size_t h = hasher(k);
+        shard &s = shard_of(h);
+        lock_guard<mutex> guard(s.lock);
+        s.map.erase_hashed_impl(h, k);
     }
 
-    /* checks if key already exists and then
-     *  if exists
-     *      erases it from list of pairs
-     *      push back this key to the list of pairs,
-     *      edge key - key exists as last and
-     *      returns false
-     *  if not
-     *      push back to the list of pairs
-     *      insert key, value and list::iterator of the ey to the map
-     *      returns true
+    bool contains(K const &k) const
+    {
+        size_t h = hasher(k);
+        shard &s = shard_of(h);
+        lock_guard<mutex> guard(s.lock);
+        return s.map.try_get_hashed_impl(h, k) != nullptr;
+    }
+
+    /* a copy of the value, a reference would outlive the lock,
+     * throws lookup_error if k is absent
      */
-    bool insert(K const &k, V const &v)
+    V at(K const &k) const
     {
-        auto it = map -> find(k);
+        size_t h = hasher(k);
+        shard &s = shard_of(h);
+        lock_guard<mutex> guard(s.lock);
+        stamped const *e = s.map.try_get_hashed_impl(h, k);
+        if (e == nullptr) {
+            throw lookup_error();
+        }
+        return e->value;
+    }
 
-        if(it != map -> end()) {
-            auto last = pairs -> end();
-            last--;
-            if(it -> second == last) {
-                return false;
-            }
+    /* may be outdated by the time it returns if other threads write */
+    size_t size() const
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < (size_t(1) << shardBits); i++) {
+            lock_guard<mutex> guard(shards[i].lock);
+            n += shards[i].map.size();
         }
+        return n;
+    }
 
-        auto prevPairs = pairs.get();
-        auto prevMap = map.get();
-        try {
-            if (!map.unique()) {
-                pairs = my_make_shared_list();
-                map = my_make_shared();
-            }
-        } catch (exception& e){
-            pairs.reset(prevPairs);
-            map.reset(prevMap);
-            throw e;
-        }
-        pair<typename unordered_map<K,typename list<pair<K,V>>::iterator, Hash>::iterator,bool> p;
-        it = map->find(k);
-        V value = v;
-        bool newElem = (it == map->end());
-        auto afterErase = pairs->begin();
-        if(!newElem){
-            value = it->second->second;
-            afterErase = pairs->erase(it->second);
-        }
-        pair<K,V> pair = make_pair(k,value);
-        pairs->push_back(pair);
-        try {
-            (*map.get())[k] = --pairs->end();
-        } catch (const exception &e) {
-            if(!newElem){
-                pairs->emplace(afterErase);
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < (size_t(1) << shardBits); i++) {
+            lock_guard<mutex> guard(shards[i].lock);
+            shards[i].map.clear();
+        }
+    }
+
+    /* all entries as they were at one moment, in insertion order */
+    insertion_ordered_map<K, V, Hash, KeyEqual, Allocator> snapshot() const
+    {
+        size_t count = size_t(1) << shardBits;
+        vector<shard_map> copies;
+        copies.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            shards[i].lock.lock();
+        }
+        for (size_t i = 0; i < count; i++) {
+            copies.push_back(shards[i].map);
+        }
+        for (size_t i = 0; i < count; i++) {
+            shards[i].lock.unlock();
+        }
+
+        using cursor = pair<typename shard_map::iterator, typename shard_map::iterator>;
+        auto later = [](cursor const &a, cursor const &b) {
+            return a.first->second.seq > b.first->second.seq;
+        };
+        vector<cursor> heap;
+        size_t total = 0;
+        for (shard_map const &m : copies) {
+            total += m.size();
+            if (!m.empty()) {
+                heap.emplace_back(m.begin(), m.end());
             }
-            pairs->pop_back();
-            throw e;
         }
-        isTaken = false;
-        return newElem;
+        make_heap(heap.begin(), heap.end(), later);
+        insertion_ordered_map<K, V, Hash, KeyEqual, Allocator> result(total, alloc);
+        while (!heap.empty()) {
+            pop_heap(heap.begin(), heap.end(), later);
+            cursor &c = heap.back();
+            result.insert(c.first->first, c.first->second.value);
+            if (++c.first == c.second) {
+                heap.pop_back();
+            } else {
+                push_heap(heap.begin(), heap.end(), later);
+            }
+        }
+        return result;
+    }
+};
+
+/* insertion_ordered_map for one writer thread and many reader threads
+ * where keys are only ever added
+ * entries live in chunks that never move, each twice the size of the one
+ * before, and an entry becomes visible when its index cell and count are
+ * stored with release, so readers take no lock and touch no counter
+ * an outgrown index is kept until destruction, as a reader may still be
+ * probing it, all of them together take less than the current one
+ */
+template <class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>,
+          class Allocator = std::allocator<std::pair<K, V>>>
+class append_only_insertion_ordered_map {
+private:
+    template <class T>
+    using alloc_of = typename allocator_traits<Allocator>::template rebind_alloc<T>;
+
+    template <class T>
+    using traits_of = allocator_traits<alloc_of<T>>;
+
+    struct entry {
+        size_t hash;
+        pair<K, V> kv;
+    };
+
+    /* cells hold 1 + the position of an entry, 0 when empty */
+    struct table {
+        size_t mask;
+        atomic<size_t> *cells;
+        table *older;
+    };
+
+    static constexpr size_t firstChunkBits = 5;
+    static constexpr size_t chunkCount = numeric_limits<size_t>::digits - firstChunkBits;
+    static constexpr size_t npos = numeric_limits<size_t>::max();
+
+    Allocator alloc;
+    Hash hasher;
+    KeyEqual equal;
+    entry *chunks[chunkCount] = {};
+    atomic<size_t> count{0};
+    atomic<table *> index{nullptr};
+
+    static size_t mix(size_t h) noexcept
+    {
+        uint64_t x = static_cast<uint64_t>(h) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(x ^ (x >> 32));
     }
 
-    void erase(K const &k){
-        auto prevPairs = pairs.get();
-        auto prevMap = map.get();
+    /* chunk c holds positions from (2^c - 1) * 32 on */
+    static size_t chunk_of(size_t pos) noexcept
+    {
+        size_t j = (pos >> firstChunkBits) + 1;
+        return static_cast<size_t>(numeric_limits<unsigned long long>::digits - 1 -
+                                   __builtin_clzll(j));
+    }
+
+    static size_t chunk_start(size_t c) noexcept
+    {
+        return ((size_t(1) << c) - 1) << firstChunkBits;
+    }
+
+    static size_t chunk_size(size_t c) noexcept
+    {
+        return size_t(1) << (c + firstChunkBits);
+    }
+
+    entry &entry_at(size_t pos) const noexcept
+    {
+        size_t c = chunk_of(pos);
+        return chunks[c][pos - chunk_start(c)];
+    }
+
+    table *new_table(size_t cells)
+    {
+        alloc_of<table> ta(alloc);
+        alloc_of<atomic<size_t>> ca(alloc);
+        table *t = traits_of<table>::allocate(ta, 1);
         try {
-            if (!map.unique()) {
-                pairs = my_make_shared_list();
-                map = my_make_shared();
-            }
-        } catch (exception& e){
-            pairs.reset(prevPairs);
-            map.reset(prevMap);
-            throw e;
-        }
-        auto it = map->find(k);
-        if(it != map->end()){
-            pairs->erase(it->second);
-            map->erase(it);
-        } else {
-            throw lookup_error();
+            t->cells = traits_of<atomic<size_t>>::allocate(ca, cells);
+        } catch (...) {
+            traits_of<table>::deallocate(ta, t, 1);
+            throw;
         }
-        isTaken = false;
+        for (size_t i = 0; i < cells; i++) {
+            new (&t->cells[i]) atomic<size_t>(0);
+        }
+        t->mask = cells - 1;
+        t->older = nullptr;
+        return t;
     }
 
-    void merge(insertion_ordered_map const &other)
+    void free_tables(table *t) noexcept
     {
-        auto prevPairs = pairs.get();
-        auto prevMap = map.get();
-        try {
-            if (!map.unique()) {
-                pairs = my_make_shared_list();
-                map = my_make_shared();
-            }
-        } catch (exception& e){
-            pairs.reset(prevPairs);
-            map.reset(prevMap);
-            throw e;
-        }
-        // now map.unique() is true
-        // makes new shared just in case that insert throws
-        auto copyPairsShared = my_make_shared_list();
-        auto copyMapShared = my_make_shared();
-        // these functions makes copies but task allows it there
-        auto it = other.pairs->begin();
-        try {
-            while(it != other.pairs->end()){
-                this->insert(it->first, it->second);
-                it++;
+        alloc_of<table> ta(alloc);
+        alloc_of<atomic<size_t>> ca(alloc);
+        while (t) {
+            table *older = t->older;
+            traits_of<atomic<size_t>>::deallocate(ca, t->cells, t->mask + 1);
+            traits_of<table>::deallocate(ta, t, 1);
+            t = older;
+        }
+    }
+
+    static void place(table *t, size_t hash, size_t pos) noexcept
+    {
+        for (size_t i = mix(hash) & t->mask;; i = (i + 1) & t->mask) {
+            if (t->cells[i].load(memory_order_relaxed) == 0) {
+                t->cells[i].store(pos + 1, memory_order_release);
+                return;
             }
-        } catch (exception &e) {
-            map = copyMapShared;
-            pairs = copyPairsShared;
-            //nothing is changed
-            throw e;
         }
-        isTaken = false;
     }
 
-    V &at(K const &k){
-        auto iter = map->find(k);
-        if(iter == map->end()){
-            throw lookup_error();
+    /* readers see either the old index or the full new one */
+    void grow_index(size_t n)
+    {
+        table *old = index.load(memory_order_relaxed);
+        table *fresh = new_table(old ? (old->mask + 1) * 2 : 64);
+        for (size_t pos = 0; pos < n; pos++) {
+            place(fresh, entry_at(pos).hash, pos);
         }
-        auto prevPairs = pairs.get();
-        auto prevMap = map.get();
-        try {
-            if (!map.unique()) {
-                pairs = my_make_shared_list();
-                map = my_make_shared();
+        fresh->older = old;
+        index.store(fresh, memory_order_release);
+    }
+
+    size_t find_pos(K const &k) const
+    {
+        return find_pos(k, hasher(k));
+    }
+
+    /* find_pos for a key whose hash h is already known */
+    size_t find_pos(K const &k, size_t h) const
+    {
+        table *t = index.load(memory_order_acquire);
+        if (!t) {
+            return npos;
+        }
+        for (size_t i = mix(h) & t->mask;; i = (i + 1) & t->mask) {
+            size_t c = t->cells[i].load(memory_order_acquire);
+            if (c == 0) {
+                return npos;
+            }
+            entry const &e = entry_at(c - 1);
+            if (e.hash == h && equal(e.kv.first, k)) {
+                return c - 1;
             }
-        } catch (const exception& e){
-            pairs.reset(prevPairs);
-            map.reset(prevMap);
-            throw e;
         }
-        isTaken = true;
-        return iter->second->second;
     }
 
-    V const &at(K const &k) const {
-        try {
-            return map->at(k)->second;
-        } catch (const std::exception& e) {
-            throw lookup_error();
+public:
+    explicit append_only_insertion_ordered_map(Allocator const &a = Allocator()) : alloc(a)
+    {}
+
+    append_only_insertion_ordered_map(append_only_insertion_ordered_map const &) = delete;
+    append_only_insertion_ordered_map &operator=(append_only_insertion_ordered_map const &) = delete;
+
+    ~append_only_insertion_ordered_map() noexcept
+    {
+        alloc_of<entry> ea(alloc);
+        size_t n = count.load(memory_order_relaxed);
+        for (size_t pos = 0; pos < n; pos++) {
+            traits_of<entry>::destroy(ea, &entry_at(pos).kv);
         }
+        for (size_t c = 0; c < chunkCount && chunks[c]; c++) {
+            traits_of<entry>::deallocate(ea, chunks[c], chunk_size(c));
+        }
+        free_tables(index.load(memory_order_relaxed));
     }
 
-    template <typename = std::enable_if_t<is_default_constructible<V>::value>>
-    V &operator[](K const &k){
-        try {
-            return this->at(k);// this handles the memory issues
-        } catch (const lookup_error& e) {
-            this->insert(k, V());
-            return this->at(k);
+    /* for the writer thread only, a present key is left where it is,
+     * strong guarantee
+     */
+    bool insert(K const &k, V const &v)
+    {
+        size_t h = hasher(k);
+        if (find_pos(k, h) != npos) {
+            return false;
+        }
+        size_t n = count.load(memory_order_relaxed);
+        table *t = index.load(memory_order_relaxed);
+        if (!t || (n + 1) * 2 > t->mask + 1) {
+            grow_index(n);
+        }
+        size_t c = chunk_of(n);
+        alloc_of<entry> ea(alloc);
+        if (!chunks[c]) {
+            chunks[c] = traits_of<entry>::allocate(ea, chunk_size(c));
         }
+        entry &e = entry_at(n);
+        traits_of<entry>::construct(ea, &e.kv, k, v);
+        e.hash = h;
+        place(index.load(memory_order_relaxed), e.hash, n);
+        count.store(n + 1, memory_order_release);
+        return true;
     }
 
-    size_t size() const noexcept
+    /* the rest is safe to call from any thread at any time */
+    bool contains(K const &k) const
     {
-        assert(map->size() == pairs->size());
-        return map->size();
+        return find_pos(k) != npos;
     }
 
-    bool empty() const noexcept
+    /* throws lookup_error if k is absent */
+    V const &at(K const &k) const
     {
-        return map->empty();
+        size_t pos = find_pos(k);
+        if (pos == npos) {
+            throw lookup_error();
+        }
+        return entry_at(pos).kv.second;
     }
 
-    void clear()
+    size_t size() const noexcept
     {
-        auto prevPairs = pairs.get();
-        auto prevMap = map.get();
-        try {
-            if (!map.unique()) {
-                pairs = my_make_shared_list();
-                map = my_make_shared();
-            } else {
-                pairs->clear();
-                map->clear();
-            }
-        } catch (exception& e){
-            pairs.reset(prevPairs);
-            map.reset(prevMap);
-            throw e;
-        }
-        isTaken = false;
+        return count.load(memory_order_acquire);
     }
 
-    bool contains(K const &k) const noexcept
+    bool empty() const noexcept
     {
-        return (map->find(k) != map->end());
+        return size() == 0;
     }
 
     class iterator {
     private:
-        const insertion_ordered_map<K,V,Hash> *map = nullptr;
-        typename list<pair<K,V>>::iterator iter;
+        const append_only_insertion_ordered_map *m = nullptr;
+        size_t pos = 0;
 
-    public:
-        ~iterator() noexcept = default;
-        iterator() noexcept = default;
+        friend class append_only_insertion_ordered_map;
 
-        iterator(const insertion_ordered_map *m, bool begin) noexcept {
-            map = m;
-            if(begin) iter = map->pairs->begin();
-            else iter = map->pairs->end();
-        }
+        iterator(const append_only_insertion_ordered_map *map, size_t p) noexcept : m(map), pos(p)
+        {}
 
-        iterator(const iterator &other) noexcept
-        {
-            map = other.map;
-            iter = other.iter;
-        }
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = pair<K,V>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const pair<K,V> *;
+        using reference = const pair<K,V> &;
 
-        iterator&  operator=(const iterator& other) noexcept {
-            map = other.map;
-            iter = other.iter;
-            return *this;
-        }
+        ~iterator() noexcept = default;
+        iterator() noexcept = default;
+        iterator(const iterator &other) noexcept = default;
+        iterator& operator=(const iterator& other) noexcept = default;
 
-        const pair<K,V>& operator*()
+        const pair<K,V>& operator*() const noexcept
         {
-            if(map == nullptr) {
-                throw exception();
-            }
-            return *iter;
+            return m->entry_at(pos).kv;
         }
 
-        const pair<K,V>* operator->()
+        const pair<K,V>* operator->() const noexcept
         {
-            if(map == nullptr) {
-                throw exception();
-            }
-            return &(*iter);
+            return &m->entry_at(pos).kv;
         }
 
-        iterator operator++()
+        iterator& operator++() noexcept
         {
-            if(map == nullptr) {
-                throw exception();
-            }
-            iter++;
+            pos++;
             return *this;
         }
 
-        bool operator==(const iterator& b) noexcept
+        bool operator==(const iterator& b) const noexcept
         {
-            return (b.map == map && iter == b.iter);
+            return pos == b.pos && m == b.m;
         }
 
-        bool operator!=(const iterator& b) noexcept
+        bool operator!=(const iterator& b) const noexcept
         {
-            return (b.map != map || iter != b.iter);
+            return !(*this == b);
         }
 
     };
 
     iterator begin() const noexcept
     {
-        iterator it(this, true);
-        return it;
+        return iterator(this, 0);
     }
 
+    /* entries inserted after end() was taken are not reached */
     iterator end() const noexcept
     {
-        iterator it(this, false);
-        return it;
+        return iterator(this, size());
     }
 };
 
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+
+/* map whose storage comes from a std::pmr::memory_resource */
+template <class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>>
+using pmr_insertion_ordered_map =
+        insertion_ordered_map<K, V, Hash, KeyEqual, std::pmr::polymorphic_allocator<std::pair<K, V>>>;
+#endif
+
 #endif // INSERTION_ORDERED_MAP_H
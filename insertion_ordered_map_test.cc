@@ -6,11 +6,16 @@
 #include <vector>
 #include <set>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <algorithm>
 #include <numeric>
 #include <random>
 #include <memory>
+#include <memory_resource>
+#include <cstdio>
+#include <thread>
+#include <atomic>
 #include <boost/operators.hpp>
 
 // ukradzione z https://github.com/facebook/folly/blob/master/folly/Benchmark.h
@@ -252,11 +257,82 @@ struct Tester
     }
 };
 
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+};
+
 struct TesterHash {
     std::hash<int> h;
     auto operator()(Tester const &i) const { ThisCanThrow(); return h(*i.p); }
 };
 
+struct CountingHash {
+    static size_t calls;
+    size_t operator()(std::string const &s) const { calls++; return std::hash<std::string>()(s); }
+};
+
+size_t CountingHash::calls = 0;
+
+struct CountedKey {
+    static size_t copies;
+    int k;
+
+    CountedKey(int key) : k(key) {}
+    CountedKey(CountedKey const &other) : k(other.k) { copies++; }
+    CountedKey(CountedKey &&other) = default;
+
+    bool operator==(CountedKey const &other) const { return k == other.k; }
+};
+
+size_t CountedKey::copies = 0;
+
+struct CountedKeyHash {
+    size_t operator()(CountedKey const &c) const { return std::hash<int>()(c.k); }
+};
+
+// zasób pamięci, który zapamiętuje, czy przydzielał pamięć poza wątkiem, który go utworzył
+class OwnerThreadResource : public std::pmr::memory_resource {
+    std::pmr::memory_resource *upstream;
+    std::thread::id owner = std::this_thread::get_id();
+
+    void *do_allocate(size_t bytes, size_t align) override {
+        if (std::this_thread::get_id() != owner)
+            foreign = true;
+        return upstream->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override {
+        if (std::this_thread::get_id() != owner)
+            foreign = true;
+        upstream->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    std::atomic<bool> foreign{false};
+
+    explicit OwnerThreadResource(std::pmr::memory_resource *up) : upstream(up) {}
+};
+
+// zasób pamięci, który liczy przydzielone bajty
+class CountingResource : public std::pmr::memory_resource {
+    void *do_allocate(size_t bytes, size_t align) override {
+        allocated += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    size_t allocated = 0;
+};
+
 int main();
 
 class CopyOnly {
@@ -993,6 +1069,921 @@ int main() {
     assert(id1 == id2);
 #endif
 
+// insert z r-wartościami, emplace i try_emplace budują wartość w miejscu
+#if TEST_NUM == 208
+    insertion_ordered_map<int, IdentityTester> q;
+    IdentityTester t;
+    auto id = t.id;
+    assert(q.insert(1, std::move(t)));
+    assert(q.at(1).id == id);
+
+    IdentityTester u;
+    id = u.id;
+    assert(q.emplace(2, std::move(u)));
+    assert(q.at(2).id == id);
+
+    auto next = IdentityTester::next;
+    assert(q.try_emplace(3));
+    assert(q.at(3).id == next);
+
+    // istniejący klucz trafia na koniec, wartość się nie zmienia
+    next = IdentityTester::next;
+    assert(!q.try_emplace(1));
+    assert(IdentityTester::next == next);
+    id = q.at(2).id;
+    assert(!q.emplace(2, IdentityTester()));
+    assert(q.at(2).id == id);
+    {
+        int order[] = {3, 1, 2};
+        int i = 0;
+        for (auto it = q.begin(), end = q.end(); it != end; ++it, ++i)
+            assert(it->first == order[i]);
+        assert(i == 3);
+    }
+
+    insertion_ordered_map<std::string, std::string> s;
+    std::string key(100, 'k'), value(100, 'v');
+    assert(s.insert(std::move(key), std::move(value)));
+    assert(s.at(std::string(100, 'k')) == std::string(100, 'v'));
+    assert(s.try_emplace("x", 3, 'y') && s.at("x") == "yyy");
+
+    // klucz, który zostaje u wołającego, nie wymusza kopiowania wartości
+    int const four = 4;
+    IdentityTester w;
+    id = w.id;
+    assert(q.insert(four, std::move(w)));
+    assert(q.at(4).id == id);
+    std::string kept(100, 'k');
+    IdentityTester x;
+    id = x.id;
+    insertion_ordered_map<std::string, IdentityTester> byName;
+    assert(byName.insert(kept, std::move(x)) && byName.at(kept).id == id && kept.size() == 100);
+#endif
+
+// wyszukiwanie po typie zgodnym z kluczem (przezroczyste Hash i KeyEqual)
+#if TEST_NUM == 209
+    insertion_ordered_map<std::string, int, StringHash, std::equal_to<>> q;
+    std::string const key(50, 'k');
+    q.insert(key, 1);
+    q.insert("b", 2);
+    std::string_view const buffer = "xxkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkxx";
+    std::string_view const k = buffer.substr(2, 50);
+
+    // żadne z wyszukiwań nie alokuje tymczasowego std::string
+    throw_countdown = 1000;
+    gChecking = true;
+    bool found = q.contains(k) && !q.contains(buffer) && q.at(k) == 1;
+    gChecking = false;
+    assert(found && throw_countdown == 1000);
+
+    insertion_ordered_map<std::string, int, StringHash, std::equal_to<>> const &qc = q;
+    assert(qc.at(std::string_view("b")) == 2);
+    q.erase(k);
+    assert(!q.contains(key) && q.size() == 1);
+    bool exception_occured = false;
+    try {
+        q.erase(k);
+    } catch (lookup_error &e) {
+        exception_occured = true;
+    }
+    assert(exception_occured);
+#endif
+
+// słownik w całości w buforze std::pmr::monotonic_buffer_resource
+#if TEST_NUM == 210
+    static char buffer[1 << 20];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+
+    // żadna operacja nie sięga do globalnego operator new
+    throw_countdown = 1000;
+    gChecking = true;
+    {
+        pmr_insertion_ordered_map<std::pmr::string, int> q(&arena);
+        char key[64];
+        for (int i = 0; i < 1000; i++) {
+            snprintf(key, sizeof(key), "%040d", i);
+            q.emplace(key, i);
+        }
+        auto copy = q;
+        snprintf(key, sizeof(key), "%040d", 7);
+        std::pmr::string k(key, &arena);
+        copy.erase(k);
+        q.at(k) = -7;
+        assert(q.size() == 1000 && copy.size() == 999);
+        assert(q.at(k) == -7 && !copy.contains(k));
+        assert(q.get_allocator().resource() == &arena);
+        assert(copy.get_allocator().resource() == &arena);
+        assert(q.begin()->first.get_allocator().resource() == &arena);
+
+        // mapa, z której przeniesiono zawartość, zachowuje alokator
+        auto moved = std::move(q);
+        assert(q.get_allocator().resource() == &arena && q.empty());
+        q.insert(k, 2);
+        assert(q.get_allocator().resource() == &arena && q.begin()->first.get_allocator().resource() == &arena);
+        assert(moved.size() == 1000 && q.size() == 1);
+        pmr_insertion_ordered_map<std::pmr::string, int> r(&arena);
+        r = std::move(moved);
+        moved.emplace(key, 3);
+        assert(moved.get_allocator().resource() == &arena && r.size() == 1000);
+    }
+    gChecking = false;
+    assert(throw_countdown == 1000);
+#endif
+
+// reserve, rehash, shrink_to_fit i konstruktor z rozmiarem
+#if TEST_NUM == 211
+    insertion_ordered_map<int, int> q(1000);
+    assert(q.empty() && q.capacity() >= 1000);
+
+    // po reserve wstawienia nie alokują
+    throw_countdown = 1000;
+    gChecking = true;
+    for (int i = 0; i < 1000; i++)
+        q.insert(i, i);
+    gChecking = false;
+    assert(throw_countdown == 1000);
+
+    q.reserve(5000);
+    assert(q.capacity() >= 5000 && q.size() == 1000);
+    auto buckets = q.bucket_count();
+    q.rehash(4 * buckets);
+    assert(q.bucket_count() >= 4 * buckets);
+    assert(q.load_factor() <= q.max_load_factor());
+
+    for (int i = 0; i < 990; i++)
+        q.erase(i);
+    q.shrink_to_fit();
+    assert(q.size() == 10 && q.capacity() >= 10 && q.capacity() < 100);
+    {
+        int i = 990;
+        for (auto it = q.begin(), end = q.end(); it != end; ++it, ++i)
+            assert(it->first == i && it->second == i && q.contains(i));
+        assert(i == 1000);
+    }
+
+    // na współdzielonym słowniku reserve robi kopię, oryginał się nie zmienia
+    auto r = q;
+    r.reserve(100);
+    r.insert(-1, -1);
+    assert(q.size() == 10 && r.size() == 11 && r.capacity() >= 100);
+
+    q.clear();
+    q.shrink_to_fit();
+    assert(q.capacity() == 0 && q.bucket_count() == 0 && q.empty());
+    q.insert(1, 1);
+    assert(q.at(1) == 1);
+#endif
+
+// wstawianie zakresu, lista inicjalizacyjna i konstruktor z zakresu
+#if TEST_NUM == 212
+    insertion_ordered_map<int, int> q{{1, 10}, {2, 20}, {3, 30}, {1, 11}};
+    assert(q.size() == 3 && q.at(1) == 10);
+    {
+        int order[] = {2, 3, 1};
+        int i = 0;
+        for (auto it = q.begin(), end = q.end(); it != end; ++it, ++i)
+            assert(it->first == order[i]);
+        assert(i == 3);
+    }
+
+    std::vector<std::pair<int, int>> v;
+    for (int i = 0; i < 100; i++)
+        v.emplace_back(i % 50, i);
+    insertion_ordered_map<int, int> r(v.begin(), v.end());
+    assert(r.size() == 50);
+    {
+        int i = 0;
+        for (auto it = r.begin(), end = r.end(); it != end; ++it, ++i)
+            assert(it->first == i && it->second == i);
+        assert(i == 50);
+    }
+
+    // zakres daje to samo co kolejne wywołania insert
+    auto s = q;
+    auto t = q;
+    s.insert(v.begin(), v.end());
+    for (auto &kv : v)
+        t.insert(kv.first, kv.second);
+    assert(s == t);
+    assert(q.size() == 3);
+
+    q.insert({{4, 40}, {2, 0}});
+    assert(q.size() == 4 && q.at(2) == 20);
+
+    std::vector<std::pair<std::string, std::string>> w{{"a", std::string(100, 'a')}, {"b", "b"}};
+    insertion_ordered_map<std::string, std::string> m(std::make_move_iterator(w.begin()),
+                                                      std::make_move_iterator(w.end()));
+    assert(m.at("a") == std::string(100, 'a') && w[0].second.empty());
+#endif
+
+// merge niewspółdzielonego słownika nie kopiuje jego zawartości
+#if TEST_NUM == 213
+    insertion_ordered_map<int, std::string> big;
+    big.reserve(10010);
+    for (int i = 0; i < 10000; i++)
+        big.insert(i, std::string(50, 'x'));
+    insertion_ordered_map<int, std::string> delta;
+    for (int i = 9995; i < 10005; i++)
+        delta.insert(i, std::string(50, 'y'));
+
+    // tylko nowe wpisy i dziennik zmian
+    throw_countdown = 1000;
+    gChecking = true;
+    big.merge(delta);
+    gChecking = false;
+    assert(throw_countdown >= 1000 - 6);
+    assert(big.size() == 10005 && big.at(9995) == std::string(50, 'x'));
+    {
+        int i = 0;
+        for (auto it = big.begin(), end = big.end(); it != end; ++it, ++i)
+            assert(it->first == i);
+        assert(i == 10005);
+    }
+
+    // merge z kopią współdzielącą pamięć niczego nie zmienia ani nie kopiuje
+    auto copy = delta;
+    throw_countdown = 1000;
+    gChecking = true;
+    delta.merge(copy);
+    gChecking = false;
+    assert(throw_countdown == 1000);
+
+    // merge z samym sobą nie unieważnia referencji
+    std::string &ref = big.at(0);
+    big.merge(big);
+    auto other = big;
+    ref = "changed";
+    assert(other.at(0) == std::string(50, 'x'));
+#endif
+
+// merge_all daje to samo co kolejne wywołania merge
+#if TEST_NUM == 214
+    std::mt19937 rng(7);
+    for (size_t threads : {0, 1, 3, 8}) {
+        std::vector<insertion_ordered_map<int, int>> maps(20);
+        for (size_t m = 0; m < maps.size(); m++)
+            for (int i = 0; i < 500; i++)
+                maps[m].insert(rng() % 3000, static_cast<int>(m));
+        maps[5] = maps[2];
+        maps[7] = std::move(maps[6]);
+
+        insertion_ordered_map<int, int> q, expected;
+        for (int i = 0; i < 100; i++)
+            q.insert(rng() % 3000, -1);
+        maps[9] = q;
+        expected = q;
+        for (auto &m : maps)
+            expected.merge(m);
+        auto old = q;
+        q.merge_all(maps, threads);
+        assert(q == expected);
+        assert(old == maps[9]);
+
+        // słownik z listy scalany sam ze sobą
+        std::vector<insertion_ordered_map<int, int>> rs{maps[0], old, maps[1]};
+        expected = old;
+        expected.merge(maps[0]);
+        expected.merge(expected);
+        expected.merge(maps[1]);
+        rs[1].merge_all(rs, threads);
+        assert(rs[1] == expected);
+    }
+
+    std::vector<insertion_ordered_map<std::string, std::string>> words(4);
+    for (int i = 0; i < 1000; i++)
+        words[i % 4].insert(std::to_string(i % 300), std::to_string(i));
+    insertion_ordered_map<std::string, std::string> w, v;
+    w.merge_all(words, 4);
+    for (auto &m : words)
+        v.merge(m);
+    assert(w == v && w.size() == 300);
+
+    // funkcja haszująca ze stanem: scalanie po kolei
+    std::vector<TesterMap> testers(3);
+    for (int i = 0; i < 30; i++)
+        testers[i % 3].insert(Tester(i % 10), Tester(i));
+    TesterMap t, u;
+    t.merge_all(testers);
+    for (auto &m : testers)
+        u.merge(m);
+    assert(t == u && t.size() == 10);
+
+    // pamięć pomocnicza też pochodzi z alokatora mapy
+    static std::byte buffer[1 << 20];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    std::pmr::vector<pmr_insertion_ordered_map<int, int>> pmaps(3, &arena);
+    for (int i = 0; i < 300; i++)
+        pmaps[i % 3].insert(i % 200, i);
+    pmr_insertion_ordered_map<int, int> pq(&arena);
+    throw_countdown = 1000;
+    gChecking = true;
+    pq.merge_all(pmaps, 1);
+    gChecking = false;
+    assert(throw_countdown == 1000 && pq.size() == 200);
+
+    // także z wieloma wątkami, ale tylko z wątku wywołującego, bo zasoby nie muszą być bezpieczne dla wątków
+    OwnerThreadResource spy(std::pmr::new_delete_resource());
+    std::pmr::vector<pmr_insertion_ordered_map<int, int>> big(4, &spy);
+    for (int i = 0; i < 40000; i++)
+        big[i % 4].insert(i % 30000, i);
+    pmr_insertion_ordered_map<int, int> bq(&spy), bexpected(&spy);
+    bq.merge_all(big, 4);
+    for (auto &m : big)
+        bexpected.merge(m);
+    assert(!spy.foreign && bq.size() == 30000);
+    assert(std::equal(bq.begin(), bq.end(), bexpected.begin(), bexpected.end()));
+#endif
+
+// merge z przenoszeniem wpisów
+#if TEST_NUM == 215
+    insertion_ordered_map<int, IdentityTester> q, r;
+    for (int i = 0; i < 10; i++)
+        q.try_emplace(i);
+    for (int i = 5; i < 15; i++)
+        r.try_emplace(i);
+    std::vector<size_t> ids;
+    for (int i = 5; i < 15; i++)
+        ids.push_back(r.at(i).id);
+
+    auto next = IdentityTester::next;
+    q.reserve(20);
+    q.merge(std::move(r));
+    assert(IdentityTester::next == next);
+    assert(q.size() == 15 && r.size() == 5);
+    for (int i = 10; i < 15; i++)
+        assert(q.at(i).id == ids[i - 5] && !r.contains(i));
+    for (int i = 5; i < 10; i++)
+        assert(r.at(i).id == ids[i - 5]);
+    {
+        int order[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14};
+        int i = 0;
+        for (auto it = q.begin(), end = q.end(); it != end; ++it, ++i)
+            assert(it->first == order[i]);
+        assert(i == 15);
+    }
+
+    // pusty słownik przejmuje pamięć drugiego
+    insertion_ordered_map<int, IdentityTester> e;
+    auto *value = &r.at(5);
+    throw_countdown = 1000;
+    gChecking = true;
+    e.merge(std::move(r));
+    gChecking = false;
+    assert(throw_countdown == 1000);
+    assert(&e.at(5) == value && e.size() == 5 && r.empty());
+
+    // współdzielony słownik zostaje nietknięty
+    insertion_ordered_map<int, IdentityTester> f;
+    f.try_emplace(100);
+    auto g = e;
+    f.merge(std::move(g));
+    assert(f.size() == 6 && g.empty() && e.size() == 5);
+
+    insertion_ordered_map<std::string, std::string> s, t;
+    s.insert("a", "a");
+    t.insert("a", "x");
+    t.insert("b", std::string(100, 'b'));
+    s.merge(std::move(t));
+    assert(s.at("a") == "a" && s.at("b") == std::string(100, 'b'));
+    assert(t.size() == 1 && t.at("a") == "x");
+#endif
+
+// extract i insert(node_type&&)
+#if TEST_NUM == 216
+    using Map = insertion_ordered_map<int, IdentityTester>;
+    Map pending, committed;
+    for (int i = 0; i < 10; i++)
+        pending.try_emplace(i);
+    committed.reserve(10);
+    auto first = pending.at(3).id;
+    auto next = IdentityTester::next;
+
+    // przenoszenie wpisów nie alokuje i nie kopiuje
+    throw_countdown = 1000;
+    gChecking = true;
+    for (int i = 0; i < 10; i += 3) {
+        Map::node_type nh = pending.extract(i);
+        assert(!nh.empty() && nh.key() == i);
+        assert(committed.insert(std::move(nh)));
+        assert(nh.empty());
+    }
+    gChecking = false;
+    assert(throw_countdown == 1000 && IdentityTester::next == next);
+    assert(pending.size() == 6 && committed.size() == 4);
+    assert(committed.at(3).id == first && !pending.contains(3));
+
+    // brak klucza daje pusty uchwyt
+    assert(!pending.extract(3));
+
+    // istniejący klucz trafia na koniec, wpis zostaje w uchwycie
+    pending.try_emplace(0);
+    auto nh = pending.extract(0);
+    committed.insert(6, IdentityTester());
+    assert(!committed.insert(std::move(nh)) && !nh.empty());
+    assert(committed.begin()->first == 3);
+
+    // zmieniony klucz jest haszowany od nowa
+    nh.key() = 42;
+    assert(committed.insert(std::move(nh)) && committed.contains(42));
+
+    // współdzielony słownik zostaje nietknięty
+    Map copy = pending;
+    auto nh2 = copy.extract(1);
+    assert(pending.contains(1) && !copy.contains(1) && nh2.key() == 1);
+
+    insertion_ordered_map<std::string, std::string> s;
+    s.insert(std::string(100, 'k'), std::string(100, 'v'));
+    auto snh = s.extract(std::string(100, 'k'));
+    assert(s.empty() && snh.mapped() == std::string(100, 'v'));
+    auto moved = std::move(snh);
+    assert(snh.empty() && moved.key() == std::string(100, 'k'));
+
+    // uchwyty działają też z polymorphic_allocator, którego nie da się przypisać
+    std::pmr::monotonic_buffer_resource arena;
+    pmr_insertion_ordered_map<int, std::pmr::string> pa(&arena), pb(&arena);
+    pa.insert(1, std::pmr::string(50, 'p'));
+    pa.insert(2, std::pmr::string(50, 'q'));
+    auto pnh = pa.extract(1);
+    assert(pnh.get_allocator().resource() == &arena);
+    decltype(pnh) pnh2;
+    pnh2 = std::move(pnh);
+    assert(pnh.empty() && pnh2.mapped() == std::pmr::string(50, 'p'));
+    assert(pb.insert(std::move(pnh2)) && pnh2.empty());
+    assert(pa.size() == 1 && pb.at(1) == std::pmr::string(50, 'p'));
+    assert(pb.begin()->second.get_allocator().resource() == &arena);
+#endif
+
+// publikowanie wersji słownika czytelnikom z innych wątków
+#if TEST_NUM == 217
+    snapshot_cell<insertion_ordered_map<int, int>> cell;
+    std::atomic<bool> finished{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++) {
+        readers.emplace_back([&cell, &finished] {
+            size_t last = 0;
+            while (!finished.load()) {
+                auto snapshot = cell.load();
+                // każda wersja v ma klucze 0..v-1, wszystkie z wartością v
+                size_t v = snapshot.size();
+                assert(v >= last);
+                last = v;
+                for (auto it = snapshot.begin(), end = snapshot.end(); it != end; ++it)
+                    assert(it->second == static_cast<int>(v));
+            }
+        });
+    }
+    for (int v = 1; v <= 300; v++) {
+        insertion_ordered_map<int, int> next;
+        for (int i = 0; i < v; i++)
+            next.insert(i, v);
+        cell.publish(next);
+        if (v % 50 == 0)
+            std::this_thread::yield();
+    }
+    finished = true;
+    for (auto &t : readers)
+        t.join();
+    cell.update([](auto &m) { m.insert(-1, 0); });
+    auto last = cell.load();
+    assert(last.size() == 301 && last.at(-1) == 0 && last.at(299) == 300);
+
+    // zapis przez at() w update nie sprawia, że kolejne odczyty kopiują cały słownik
+    cell.update([](auto &m) { m.at(7) = -7; });
+    throw_countdown = 1000;
+    gChecking = true;
+    auto patched = cell.load();
+    gChecking = false;
+    assert(throw_countdown == 1000);
+    assert(patched.size() == 301 && patched.at(7) == -7 && last.at(7) == 300);
+#endif
+
+// zapis z wielu wątków naraz i migawka w kolejności wstawiania
+#if TEST_NUM == 218
+    concurrent_insertion_ordered_map<int, int> cq(8);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++) {
+        writers.emplace_back([&cq, t] {
+            // wątek t wstawia klucze t, t+4, ..., a co piąty wstawia ponownie klucz -1
+            for (int i = t; i < 4000; i += 4) {
+                cq.insert(i, t);
+                if (i % 5 == 0)
+                    cq.insert(-1, i);
+                if (i % 7 == 0)
+                    cq.erase(i);
+            }
+        });
+    }
+    for (auto &t : writers)
+        t.join();
+    auto snapshot = cq.snapshot();
+    assert(snapshot.size() == cq.size() && cq.contains(-1) && !cq.contains(7));
+    assert(cq.at(-1) == snapshot.at(-1) && cq.at(5) == 1);
+    // kolejność kluczy każdego wątku się zgadza
+    int lastOf[4] = {-1, -1, -1, -1};
+    for (auto it = snapshot.begin(), end = snapshot.end(); it != end; ++it) {
+        if (it->first < 0)
+            continue;
+        assert(it->first % 7 != 0 && it->second == it->first % 4);
+        assert(it->first > lastOf[it->second]);
+        lastOf[it->second] = it->first;
+    }
+    bool thrown = false;
+    try {
+        cq.erase(7);
+    } catch (lookup_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+    // jak w insertion_ordered_map: klucz idzie na koniec, wartość zostaje
+    assert(!cq.insert(3, 30) && cq.at(3) == 3);
+    auto moved = cq.snapshot();
+    int lastKey = 0;
+    for (auto it = moved.begin(), end = moved.end(); it != end; ++it)
+        lastKey = it->first;
+    assert(lastKey == 3);
+    // ponowne wstawienie ostatniego klucza fragmentu nie blokuje współdzielenia przy migawce
+    throw_countdown = 1L << 30;
+    gChecking = true;
+    (void)cq.snapshot();
+    gChecking = false;
+    long snapshotCost = (1L << 30) - throw_countdown;
+    assert(!cq.insert(3, 31) && cq.at(3) == 3);
+    throw_countdown = 1L << 30;
+    gChecking = true;
+    (void)cq.snapshot();
+    gChecking = false;
+    assert((1L << 30) - throw_countdown == snapshotCost);
+    // klucz jest haszowany raz na operację, fragment używa skrótu, który go wybrał
+    concurrent_insertion_ordered_map<std::string, int, CountingHash> sq(4);
+    CountingHash::calls = 0;
+    sq.insert("a", 1);
+    sq.insert("a", 2);
+    assert(sq.contains("a") && sq.at("a") == 1);
+    sq.erase("a");
+    assert(CountingHash::calls == 5 && sq.empty());
+    cq.clear();
+    assert(cq.empty() && cq.snapshot().empty());
+    // z alokatorem pmr wszystkie fragmenty i migawka biorą pamięć z areny
+    std::pmr::monotonic_buffer_resource arena;
+    concurrent_insertion_ordered_map<int, std::pmr::string, std::hash<int>, std::equal_to<int>,
+            std::pmr::polymorphic_allocator<std::pair<int, std::pmr::string>>> pq(4, &arena);
+    pq.insert(1, "a");
+    pq.insert(2, "b");
+    assert(!pq.insert(1, "c") && pq.at(1) == "a");
+    auto psnap = pq.snapshot();
+    assert(psnap.get_allocator().resource() == &arena);
+    assert(psnap.begin()->first == 2 && psnap.at(1).get_allocator().resource() == &arena);
+#endif
+
+// słownik tylko do dopisywania czytany bez blokad
+#if TEST_NUM == 219
+    append_only_insertion_ordered_map<int, int> am;
+    std::atomic<bool> finished{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++) {
+        readers.emplace_back([&am, &finished] {
+            while (!finished.load()) {
+                // wszystko, co widać w size(), musi być już widać po kluczu
+                int n = static_cast<int>(am.size());
+                if (n > 0)
+                    assert(am.contains(n - 1) && am.at(n - 1) == 2 * (n - 1));
+                int expected = 0;
+                for (auto it = am.begin(), end = am.end(); it != end; ++it, ++expected)
+                    assert(it->first == expected && it->second == 2 * expected);
+                assert(expected >= n && !am.contains(-1));
+            }
+        });
+    }
+    for (int i = 0; i < 100000; i++)
+        assert(am.insert(i, 2 * i));
+    assert(!am.insert(5, 0) && am.at(5) == 10);
+    finished = true;
+    for (auto &t : readers)
+        t.join();
+    assert(am.size() == 100000 && am.begin()->first == 0);
+
+    append_only_insertion_ordered_map<std::string, std::string> as;
+    for (int i = 0; i < 1000; i++)
+        as.insert(std::to_string(i), std::string(30, 'a' + i % 26));
+    assert(as.size() == 1000 && as.at("999") == std::string(30, 'a' + 999 % 26));
+    bool thrown = false;
+    try {
+        as.at("1000");
+    } catch (lookup_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // zapisujący haszuje klucz raz na wstawienie
+    append_only_insertion_ordered_map<std::string, int, CountingHash> ac;
+    CountingHash::calls = 0;
+    for (int i = 0; i < 100; i++)
+        ac.insert(std::to_string(i), i);
+    assert(!ac.insert("7", 0) && CountingHash::calls == 101);
+#endif
+
+// find, try_get i operator[] bez wyjątków dla brakujących kluczy
+#if TEST_NUM == 220
+    insertion_ordered_map<int, std::string> q;
+    for (int i = 0; i < 100; i++)
+        q.insert(i, std::to_string(i));
+    auto const &cq = q;
+    auto copy = q;
+    throw_countdown = 1000;
+    gChecking = true;
+    // wyszukiwanie bez wyjątków nie kopiuje współdzielonej mapy
+    auto it = cq.find(42);
+    assert(it != cq.end() && it->first == 42 && it->second == "42");
+    assert(cq.find(100) == cq.end() && cq.try_get(100) == nullptr);
+    assert(*cq.try_get(7) == "7");
+    gChecking = false;
+    assert(throw_countdown == 1000);
+    for (it = cq.find(97); it != cq.end(); ++it)
+        assert(it->first >= 97);
+
+    // wersja niestała kopiuje, tak jak at()
+    *q.try_get(7) = "seven";
+    assert(q.at(7) == "seven" && copy.at(7) == "7" && q.try_get(-1) == nullptr);
+
+    // operator[] wstawia przy braku klucza i zwraca istniejącą wartość
+    insertion_ordered_map<int, int> counts;
+    for (int i = 0; i < 1000; i++)
+        counts[i % 10]++;
+    assert(counts.size() == 10 && counts.at(3) == 100);
+    int expected = 0;
+    for (auto c = counts.begin(), end = counts.end(); c != end; ++c)
+        assert(c->first == expected++);
+    auto shared = counts;
+    counts[3] = 0;
+    assert(shared.at(3) == 100 && counts.at(3) == 0);
+#endif
+
+// zapamiętane skróty, insert_hashed i erase(iterator)
+#if TEST_NUM == 221
+    using CountingMap = insertion_ordered_map<std::string, int, CountingHash>;
+    CountingMap q, delta;
+    for (int i = 0; i < 1000; i++)
+        q.insert(std::to_string(i) + std::string(40, 'k'), i);
+    for (int i = 900; i < 1500; i++)
+        delta.insert(std::to_string(i) + std::string(40, 'k'), i);
+    assert(CountingHash::calls == 1600);
+    // rehash, kopia, merge i erase(iterator) korzystają z zapamiętanych haszy
+    q.reserve(100000);
+    CountingMap copy = q;
+    copy.at("5" + std::string(40, 'k')) = -5;
+    CountingMap deep = copy;
+    q.merge(delta);
+    auto it = copy.begin();
+    ++it;
+    it = copy.erase(it);
+    assert(it->first == "2" + std::string(40, 'k'));
+    assert(CountingHash::calls == 1600 + 1);
+    assert(q.size() == 1500 && copy.size() == 999 && deep.size() == 1000);
+    assert(!copy.contains("1" + std::string(40, 'k')));
+
+    // insert_hashed nie haszuje ponownie
+    std::string key = "hashed";
+    size_t h = CountingHash()(key);
+    size_t calls = CountingHash::calls;
+    assert(q.insert_hashed(h, key, 1) && !q.insert_hashed(h, key, 2));
+    assert(CountingHash::calls == calls && q.at(key) == 1);
+
+    // erase(iterator) aż do końca
+    insertion_ordered_map<int, int> e{{1, 1}, {2, 2}, {3, 3}};
+    auto shared = e;
+    for (auto i = e.begin(); i != e.end();)
+        i = e.erase(i);
+    assert(e.empty() && shared.size() == 3);
+#endif
+
+// klucz przechowywany raz, bez kopii w indeksie
+#if TEST_NUM == 222
+    // klucz jest trzymany tylko we wpisie, indeks odwołuje się do niego przez numer
+    insertion_ordered_map<CountedKey, int, CountedKeyHash> q;
+    for (int i = 0; i < 1000; i++) {
+        CountedKey k(i);
+        q.insert(k, i);
+    }
+    assert(CountedKey::copies == 1000);
+    q.reserve(5000);
+    q.erase(CountedKey(3));
+    assert(CountedKey::copies == 1000);
+    auto copy = q;
+    copy.at(CountedKey(500)) = -1;
+    auto deep = copy;
+    assert(CountedKey::copies <= 1000 + 64 + 999);
+    assert(deep.size() == 999 && deep.at(CountedKey(500)) == -1 && q.at(CountedKey(500)) == 500);
+#endif
+
+// mały słownik bez indeksu
+#if TEST_NUM == 223
+    // do 8 wpisów mapa nie ma indeksu, wystarczy magazyn, tablica stron i jedna strona
+    insertion_ordered_map<std::string, int> q;
+    throw_countdown = 1000;
+    gChecking = true;
+    for (int i = 0; i < 8; i++)
+        q.insert("k" + std::to_string(i), i);
+    assert(q.contains("k3") && !q.contains("k8") && q.at("k7") == 7);
+    gChecking = false;
+    assert(throw_countdown == 1000 - 3);
+    assert(q.bucket_count() == 0 && q.capacity() == 8);
+
+    q.insert("k8", 8);
+    assert(q.bucket_count() > 0 && q.at("k8") == 8);
+    for (int i = 0; i < 6; i++)
+        q.erase("k" + std::to_string(i));
+    q.rehash(0);
+    assert(q.bucket_count() == 0 && q.size() == 3);
+    assert(q.at("k6") == 6 && q.find("k2") == q.end());
+
+    // zmiany w małej mapie współdzielącej strony
+    auto copy = q;
+    q.erase("k7");
+    q.insert("k6", 0);
+    q.insert("new", 1);
+    std::string order;
+    for (auto it = q.begin(); it != q.end(); ++it)
+        order += it->first;
+    assert(order == "k8k6new" && copy.size() == 3 && copy.at("k7") == 7);
+    q.shrink_to_fit();
+    assert(q.bucket_count() == 0 && q.at("new") == 1);
+#endif
+
+// słownik bez magazynu nie alokuje, dopóki nic nie wstawiono
+#if TEST_NUM == 224
+    // pusta mapa nie ma magazynu, dostaje go przy pierwszym zapisie
+    throw_countdown = 1000;
+    gChecking = true;
+    {
+        insertion_ordered_map<std::string, int> a;
+        insertion_ordered_map<std::string, int> b(a);
+        insertion_ordered_map<std::string, int> c(std::move(b));
+        c = a;
+        assert(a.empty() && c.size() == 0 && a.begin() == a.end());
+        assert(!a.contains("x") && a.find("x") == a.end() && a.try_get("x") == nullptr);
+        a.clear();
+        a.merge(c);
+    }
+    static_assert(noexcept(insertion_ordered_map<std::string, int>()));
+    gChecking = false;
+    assert(throw_countdown == 1000);
+
+    insertion_ordered_map<std::string, int> q;
+    q.insert("a", 1);
+    q.insert("b", 2);
+    auto copy = q;
+    throw_countdown = 1000;
+    gChecking = true;
+    // czyszczenie współdzielonej mapy tylko odpina magazyn
+    q.clear();
+    gChecking = false;
+    assert(throw_countdown == 1000);
+    assert(q.empty() && copy.size() == 2);
+    q.insert("c", 3);
+    assert(q.size() == 1 && q.at("c") == 3 && copy.at("a") == 1);
+
+    bool thrown = false;
+    try {
+        insertion_ordered_map<int, int> e;
+        e.erase(1);
+    } catch (lookup_error &) {
+        thrown = true;
+    }
+    assert(thrown);
+#endif
+
+// upakowywanie wpisów przy usuwaniu i max_free_fraction
+#if TEST_NUM == 225
+    insertion_ordered_map<int, std::string> q, loose;
+    loose.max_free_fraction(1.0f);
+    assert(q.max_free_fraction() == 0.5f && loose.max_free_fraction() == 1.0f);
+    for (int i = 0; i < 10000; i++) {
+        q.insert(i, std::to_string(i));
+        loose.insert(i, std::to_string(i));
+    }
+    size_t full = q.capacity();
+    // usuwanie 3 z 4 wpisów upakowuje mapę, kolejność zostaje
+    for (int i = 0; i < 10000; i++) {
+        if (i % 4 != 0) {
+            q.erase(i);
+            loose.erase(i);
+        }
+    }
+    assert(q.size() == 2500 && q.capacity() < full && loose.capacity() == full);
+    int expected = 0;
+    for (auto it = q.begin(); it != q.end(); ++it, expected += 4)
+        assert(it->first == expected && it->second == std::to_string(expected));
+    assert(expected == 10000);
+
+    // erase(iterator) zwraca następny wpis także wtedy, gdy upakowanie przesuwa wpisy
+    for (auto it = q.begin(); it != q.end();) {
+        int k = it->first;
+        if (k % 8 == 0) {
+            it = q.erase(it);
+            assert(it == q.end() || it->first == k + 4);
+        } else {
+            ++it;
+        }
+    }
+    assert(q.size() == 1250 && q.at(4) == "4" && !q.contains(8));
+
+    // współdzielona mapa jest pakowana przez kopiowanie, kopia zostaje nietknięta
+    auto copy = q;
+    for (int i = 4; i < 10000; i += 16)
+        q.erase(i);
+    assert(copy.size() == 1250 && copy.at(4) == "4" && q.size() == 625);
+
+    // usuwanie od początku przy żywej kopii też pakuje, zamiast za każdym razem sprawdzać strony
+    insertion_ordered_map<int, int> big;
+    for (int i = 0; i < 40000; i++)
+        big.insert(i, i);
+    auto live = big;
+    size_t bigFull = big.capacity();
+    for (int i = 0; i < 30000; i++)
+        big.erase(i);
+    assert(big.size() == 10000 && big.capacity() < bigFull && big.begin()->first == 30000);
+    assert(live.size() == 40000 && live.capacity() == bigFull && live.at(0) == 0);
+
+    // klucz podany do erase może leżeć w samej mapie, a upakowanie go przenosi
+    insertion_ordered_map<std::string, int> front;
+    for (int i = 0; i < 1000; i++)
+        front.insert(std::to_string(i), i);
+    for (int i = 0; i < 990; i++) {
+        assert(front.begin()->second == i);
+        front.erase(front.begin()->first);
+    }
+    assert(front.size() == 10 && front.at("995") == 995);
+
+    // ustawienie przeżywa clear(), merge_all i mapę jeszcze bez magazynu
+    insertion_ordered_map<int, std::string> lazy;
+    lazy.max_free_fraction(1.0f);
+    loose.clear();
+    auto shared = loose;
+    shared.clear();
+    for (int i = 0; i < 10000; i++) {
+        lazy.insert(i, std::to_string(i));
+        shared.insert(i, std::to_string(i));
+    }
+    std::vector<insertion_ordered_map<int, std::string>> more{lazy};
+    shared.merge_all(more);
+    full = lazy.capacity();
+    size_t sharedFull = shared.capacity();
+    for (int i = 0; i < 9000; i++) {
+        lazy.erase(i);
+        shared.erase(i);
+    }
+    assert(lazy.max_free_fraction() == 1.0f && shared.max_free_fraction() == 1.0f);
+    assert(lazy.capacity() == full && shared.capacity() == sharedFull);
+    // przeniesienie magazynu w merge(&&) nie zabiera ustawienia
+    insertion_ordered_map<int, std::string> taker;
+    taker.merge(std::move(lazy));
+    assert(taker.max_free_fraction() == 0.5f && lazy.max_free_fraction() == 1.0f);
+
+    bool thrown = false;
+    try {
+        q.max_free_fraction(0.0f);
+    } catch (std::invalid_argument &) {
+        thrown = true;
+    }
+    assert(thrown && q.max_free_fraction() == 0.5f);
+#endif
+
+// contains_many i find_many z wyprzedzającym pobieraniem
+#if TEST_NUM == 226
+    insertion_ordered_map<int, int> q;
+    std::vector<int> keys;
+    for (int i = 0; i < 1000; i++) {
+        q.insert(2 * i, i);
+        keys.push_back(i);
+    }
+    std::vector<bool> found(keys.size());
+    std::vector<int const *> values(keys.size());
+    throw_countdown = 1000;
+    gChecking = true;
+    auto const &cq = q;
+    auto endFound = cq.contains_many(keys.begin(), keys.end(), found.begin());
+    auto endValues = cq.find_many(keys.begin(), keys.end(), values.begin());
+    gChecking = false;
+    assert(throw_countdown == 1000);
+    assert(endFound == found.end() && endValues == values.end());
+    for (int i = 0; i < 1000; i++) {
+        assert(found[i] == (i % 2 == 0));
+        assert(i % 2 == 0 ? *values[i] == i / 2 : values[i] == nullptr);
+    }
+
+    // mała mapa bez indeksu, mapa bez magazynu i pusty zakres
+    insertion_ordered_map<std::string, int> small{{"a", 1}, {"b", 2}};
+    std::string names[] = {"b", "c", "a"};
+    std::vector<int const *> out;
+    small.find_many(std::begin(names), std::end(names), std::back_inserter(out));
+    assert(out.size() == 3 && *out[0] == 2 && out[1] == nullptr && *out[2] == 1);
+    insertion_ordered_map<std::string, int> none;
+    bool flags[3] = {true, true, true};
+    none.contains_many(std::begin(names), std::end(names), flags);
+    assert(!flags[0] && !flags[1] && !flags[2]);
+    assert(small.contains_many(names, names, flags) == flags);
+#endif
+
 // Dodatkowe testy zgodności z treścią:
 	// - testy gwarancji no-throw: konstruktor przenoszący, destruktor
 	// - testy założeń nt. typu V
@@ -1269,6 +2260,94 @@ int main() {
     }
 #endif
 
+// wstawianie zakresu
+#if TEST_NUM == 407
+    std::vector<std::pair<Tester, Tester>> v;
+    for (int i = 0; i < 6; i++)
+        v.emplace_back(Tester(i % 4), Tester(i));
+    for (int i = 0; i < max_throw_countdown; i++, throw_countdown = i) {
+        TesterMap q;
+
+        q.insert(Tester(1), Tester(42));
+        q.insert(Tester(5), Tester(13));
+        q.insert(Tester(2), Tester());
+
+        StrongCheckVoid(q, [&v](auto &q) { q.insert(v.begin(), v.end()); }, "insert(first, last)");
+        StrongCheckVoid(q, [&v](auto &q) { q.insert(v.rbegin(), v.rend()); }, "insert(first, last)");
+    }
+#endif
+
+// merge_all
+#if TEST_NUM == 408
+    std::vector<insertion_ordered_map<int, Tester>> maps(3);
+    for (int i = 0; i < 9; i++)
+        maps[i % 3].insert(i % 5, Tester(i));
+    for (int i = 0; i < max_throw_countdown; i++, throw_countdown = i) {
+        insertion_ordered_map<int, Tester> q;
+
+        q.insert(1, Tester(42));
+        q.insert(7, Tester(13));
+
+        StrongCheckVoid(q, [&maps](auto &q) { q.merge_all(maps, 1); }, "merge_all");
+    }
+#endif
+
+// merge z przenoszeniem wpisów
+#if TEST_NUM == 409
+    for (int i = 0; i < max_throw_countdown; i++, throw_countdown = i) {
+        TesterMap q, r;
+
+        q.insert(Tester(1), Tester(42));
+        q.insert(Tester(2), Tester(13));
+        r.insert(Tester(2), Tester(1));
+        r.insert(Tester(3), Tester(1));
+        r.insert(Tester(1), Tester(1));
+        r.insert(Tester(4), Tester(1));
+        TesterMap before = r;
+
+        StrongCheckVoid(q, [&r](auto &q) { q.merge(std::move(r)); }, "merge(&&)");
+        assert(r.size() == 4 || r.size() == 2);
+        if (r.size() == 4)
+            assert(r == before);
+    }
+#endif
+
+// ponowne wstawienie do concurrent_insertion_ordered_map
+#if TEST_NUM == 410
+    for (int i = 0; i < max_throw_countdown; i++, throw_countdown = i) {
+        concurrent_insertion_ordered_map<Tester, Tester, TesterHash> cq(1);
+        for (int k = 0; k < 6; k++)
+            cq.insert(Tester(k), Tester(k));
+        TesterMap before = cq.snapshot();
+        bool thrown = false;
+        try {
+            gChecking = true;
+            cq.insert(Tester(2), Tester(7));
+            gChecking = false;
+        } catch (...) {
+            gChecking = false;
+            thrown = true;
+        }
+        TesterMap after = cq.snapshot();
+        if (thrown) {
+            assert(after == before);
+        } else {
+            assert(after.size() == 6 && after.at(Tester(2)) == Tester(2));
+            auto last = after.begin();
+            for (auto it = after.begin(); it != after.end(); ++it)
+                last = it;
+            assert(last->first == Tester(2));
+        }
+        // po nieudanym wstawieniu kolejność i numery wciąż się zgadzają
+        cq.insert(Tester(0), Tester(0));
+        TesterMap moved = cq.snapshot();
+        auto last = moved.begin();
+        for (auto it = moved.begin(); it != moved.end(); ++it)
+            last = it;
+        assert(last->first == Tester(0));
+    }
+#endif
+
 // Czy rzucane są wyjątki zgodnie ze specyfikacją?
 
 // at
@@ -1428,6 +2507,89 @@ int main() {
     }
 #endif
 
+// Kopia to jeden wskaźnik na współdzielone dane i flaga.
+#if TEST_NUM == 606
+    static_assert(sizeof(insertion_ordered_map<int, int>) <= 2 * sizeof(void *));
+    insertion_ordered_map<int, int> q;
+    q.insert(1, 1);
+    std::vector<insertion_ordered_map<int, int>> vec(1000, q);
+    vec[500].insert(2, 2);
+    assert(q.size() == 1 && vec[0].size() == 1 && vec[500].size() == 2);
+    vec.clear();
+    assert(q.at(1) == 1);
+#endif
+
+// Przypisanie przeniesionego słownika zachowuje flagę unshareable.
+#if TEST_NUM == 608
+    insertion_ordered_map<int, int> a, b;
+    a.insert(1, 1);
+    int &r = a.at(1);
+    b = std::move(a);
+    auto c = b;
+    r = 5;
+    assert(b.at(1) == 5 && c.at(1) == 1);
+#endif
+
+// Zapis do współdzielonego słownika kopiuje tylko zmienianą stronę wpisów.
+#if TEST_NUM == 607
+    insertion_ordered_map<int, std::string> q;
+    for (int i = 0; i < 100000; i++)
+        q.insert(i, std::to_string(i) + std::string(20, 'x'));
+    auto r = q;
+    auto const &cq = q;
+
+    throw_countdown = 1000;
+    gChecking = true;
+    r.at(500) = "changed";
+    gChecking = false;
+    // nowa pamięć, tablica stron i jedna strona z jej napisami
+    assert(throw_countdown >= 1000 - 40);
+    assert(cq.at(500) != "changed" && r.at(500) == "changed");
+
+    auto s = q;
+    throw_countdown = 1000;
+    gChecking = true;
+    s.insert(-1, "new");
+    s.erase(7);
+    gChecking = false;
+    assert(throw_countdown >= 1000 - 120);
+    assert(q.size() == 100000 && q.contains(7) && !q.contains(-1));
+    assert(s.size() == 100000 && !s.contains(7) && s.at(-1) == "new");
+    for (int i = 0; i < 100000; i += 1000)
+        assert(cq.at(i) == std::to_string(i) + std::string(20, 'x'));
+
+    // zapis zmieniający strukturę kopiuje najwyżej kilka stron wpisów, ale
+    // za to całą tablicę stron i cały indeks, czyli O(n), a nie O(log n)
+    insertion_ordered_map<CountedKey, int, CountedKeyHash> keys;
+    for (int i = 0; i < 100000; i++)
+        keys.insert(CountedKey(i), i);
+    auto keysCopy = keys;
+    CountedKey::copies = 0;
+    keysCopy.insert(CountedKey(-1), -1);
+    keysCopy.erase(CountedKey(500));
+    // strona ostatniego wpisu oraz strony usuwanego wpisu i jego sąsiadów
+    assert(CountedKey::copies <= 4 * 32);
+    assert(keys.size() == 100000 && keysCopy.size() == 100000);
+
+    CountingResource counting;
+    pmr_insertion_ordered_map<int, int> pq(&counting);
+    for (int i = 0; i < 100000; i++)
+        pq.insert(i, i);
+    auto pcopy = pq;
+    size_t indexBytes = pq.bucket_count() * (sizeof(int8_t) + sizeof(uint32_t));
+    // magazyn rośnie dwukrotnie, więc ma najwyżej 2n miejsc po 32 na stronę
+    size_t pageTableBytes = 2 * pq.size() / 32 * sizeof(void *);
+    counting.allocated = 0;
+    pcopy.insert(-1, -1);
+    assert(counting.allocated >= indexBytes);
+    assert(counting.allocated < indexBytes + pageTableBytes + 16 * 1024);
+    // kolejne zapisy w już odłączonej kopii biorą tylko zmieniane strony
+    counting.allocated = 0;
+    pcopy.erase(7);
+    assert(counting.allocated < 4 * 1024);
+    assert(!pq.contains(-1) && pq.contains(7) && pcopy.contains(-1) && !pcopy.contains(7));
+#endif
+
 // Test sprawdzający, czy jest header guard.
 
 #if TEST_NUM == 700